@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+    #include <signal.h>
+    #include <sys/ptrace.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+#define ARRAY_SIZE(x) (sizeof(x)/sizeof((x)[0]))
+#define NOT_AVAILABLE (-1)
+
+typedef void (*BenchmarkFunction)(void *context);
+
+typedef struct Benchmark {
+    const char *name;
+    void (*run)(const char *workDir);
+} Benchmark;
+
+
+static double nowSeconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+static double measureSeconds(BenchmarkFunction function, void *context) {
+    double start = nowSeconds();
+    function(context);
+    return nowSeconds() - start;
+}
+
+// Runs function in a traced child process and returns number of system calls it made,
+// or NOT_AVAILABLE when ptrace is not permitted (containers, non Linux platforms)
+static long countSyscalls(BenchmarkFunction function, void *context) {
+#if defined(__linux__)
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == -1) return NOT_AVAILABLE;
+
+    if (child == 0) {
+        if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) == -1) _exit(1);
+        raise(SIGSTOP);
+        function(context);
+        _exit(0);
+    }
+
+    int status;
+    if (waitpid(child, &status, 0) == -1 || !WIFSTOPPED(status)) {
+        return NOT_AVAILABLE;
+    }
+
+    long stops = 0;
+    while (ptrace(PTRACE_SYSCALL, child, NULL, NULL) == 0) {
+        if (waitpid(child, &status, 0) == -1 || WIFEXITED(status) || WIFSIGNALED(status)) break;
+        stops++;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? stops / 2 : NOT_AVAILABLE;   // entry and exit stop for each call
+#else
+    (void) function;
+    (void) context;
+    return NOT_AVAILABLE;
+#endif
+}
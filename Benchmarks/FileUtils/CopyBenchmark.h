@@ -0,0 +1,296 @@
+#pragma once
+
+#include "BaseBenchmarkTemplate.h"
+#include "FileUtils.h"
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    #include <sys/statvfs.h>
+    #include <fcntl.h>
+#endif
+
+#define COPY_BENCH_BLOCK_SIZE ONE_MB
+#define COPY_BENCH_MIN_BYTES (256 * ONE_MB)     // small files are copied many times to get stable time
+
+static const char *copyStrategyNames[] = {"none", "clone", "copy_file_range()", "sendfile()", "read()/write()", "sparse"};
+
+typedef struct CopyContext {
+    File *src;
+    File *dest;
+    uint32_t repeats;
+} CopyContext;
+
+
+// Reference copy as it was done before: byte by byte through stdio streams
+static bool copyFileByChars(File *srcFile, File *destFile) {
+    FILE *src = fopen(srcFile->path, "r");
+    FILE *dest = fopen(destFile->path, "w");
+    if (src == NULL || dest == NULL) {
+        if (src != NULL) fclose(src);
+        if (dest != NULL) fclose(dest);
+        return false;
+    }
+
+    int dataChar;
+    while ((dataChar = fgetc(src)) != EOF) {
+        fputc(dataChar, dest);
+    }
+    fclose(src);
+    fclose(dest);
+    return true;
+}
+
+static void runCopyByChars(void *context) {
+    CopyContext *copy = context;
+    for (uint32_t i = 0; i < copy->repeats; i++) {
+        copyFileByChars(copy->src, copy->dest);
+    }
+}
+
+static void runCopyFile(void *context) {
+    CopyContext *copy = context;
+    for (uint32_t i = 0; i < copy->repeats; i++) {
+        copyFile(copy->src, copy->dest);
+    }
+}
+
+static bool createCopySource(File *file, uint64_t size) {
+    FILE *stream = fopen(file->path, "wb");
+    if (stream == NULL) return false;
+
+    char *block = malloc(COPY_BENCH_BLOCK_SIZE);
+    if (block == NULL) {
+        fclose(stream);
+        return false;
+    }
+    for (uint32_t i = 0; i < COPY_BENCH_BLOCK_SIZE; i++) {
+        block[i] = (char) (i * 31 + i / 251);    // not zeros, so filesystem can't skip data
+    }
+
+    bool isWritten = true;
+    for (uint64_t written = 0; written < size && isWritten;) {
+        uint64_t length = size - written < COPY_BENCH_BLOCK_SIZE ? size - written : COPY_BENCH_BLOCK_SIZE;
+        isWritten = fwrite(block, 1, length, stream) == length;
+        written += length;
+    }
+    free(block);
+    return fclose(stream) == 0 && isWritten;
+}
+
+static bool isEnoughSpaceForCopy(File *dir, uint64_t size) {
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct statvfs info;
+    if (statvfs(dir->path, &info) == 0) {
+        return (uint64_t) info.f_bavail * info.f_frsize > size * 2 + ONE_GB;    // source, copy and some free space left
+    }
+#endif
+    return true;
+}
+
+static void reportCopy(const char *name, BenchmarkFunction function, CopyContext *context, uint64_t size) {
+    double seconds = measureSeconds(function, context);
+    double bytes = (double) size * context->repeats;
+    printf("  %-24s %8.3f ms  %9.1f MB/s", name, seconds * 1e3, bytes / seconds / ONE_MB);
+
+    long syscalls = countSyscalls(function, context);
+    if (syscalls == NOT_AVAILABLE) {
+        printf("\n");
+    } else {
+        printf("  syscalls/copy: %.1f\n", (double) syscalls / context->repeats);
+    }
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static void runCopyAllBytes(void *context) {  // reference copy that reads holes as zeros and writes them
+    CopyContext *copy = context;
+    int srcFd = open(copy->src->path, O_RDONLY);
+    int destFd = open(copy->dest->path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    char *buffer = malloc(COPY_BENCH_BLOCK_SIZE);
+    ssize_t length;
+    while (buffer != NULL && srcFd != -1 && destFd != -1 && (length = read(srcFd, buffer, COPY_BENCH_BLOCK_SIZE)) > 0) {
+        if (write(destFd, buffer, length) != length) break;
+    }
+    free(buffer);
+    if (srcFd != -1) close(srcFd);
+    if (destFd != -1) close(destFd);
+}
+
+static void reportAllocatedSize(const char *name, File *file) {
+    struct stat info;
+    if (stat(file->path, &info) == 0) {
+        printf("  %-24s allocated: %8.1f MB of %.1f MB\n", name, (double) info.st_blocks * 512 / ONE_MB, (double) info.st_size / ONE_MB);
+    }
+}
+#endif
+
+// Image with few data extents and holes between them, like VM disk or preallocated database file
+static void reportSparseCopy(File *benchDir) {
+#if !defined(_WIN32) && !defined(_WIN64)
+    CopyContext context = {.src = FILE_OF(benchDir, "/image.bin"), .dest = FILE_OF(benchDir, "/image_copy.bin"), .repeats = 1};
+    int fd = open(context.src->path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    char *block = calloc(1, COPY_BENCH_BLOCK_SIZE);
+    if (fd == -1 || block == NULL || ftruncate(fd, (off_t) ONE_GB) != 0) {
+        printf("Sparse file: skipped\n");
+        if (fd != -1) close(fd);
+        free(block);
+        return;
+    }
+    memset(block, 'x', COPY_BENCH_BLOCK_SIZE);
+    for (uint64_t offset = 0; offset < ONE_GB; offset += 64 * ONE_MB) {  // 16 MB of data in 1 GB file
+        pwrite(fd, block, COPY_BENCH_BLOCK_SIZE, (off_t) offset);
+    }
+    close(fd);
+    free(block);
+
+    printf("1 GB sparse file with 16 MB of data:\n");
+    reportCopy("read()/write() all bytes", runCopyAllBytes, &context, ONE_GB);
+    reportAllocatedSize("read()/write() all bytes", context.dest);
+    reportCopy("copyFile()", runCopyFile, &context, ONE_GB);
+    reportAllocatedSize("copyFile()", context.dest);
+    printf("  copyFileWithMode() strategy: %s\n", copyStrategyNames[copyFileWithMode(context.src, context.dest, COPY_MODE_CLONE_OR_COPY)]);
+    remove(context.dest->path);
+    remove(context.src->path);
+#endif
+}
+
+static void benchmarkFileCopy(const char *workDir) {
+    File *benchDir = FILE_OF(NEW_FILE(workDir), "/copy");
+    deleteDirectory(benchDir);
+    createSubDirs(benchDir);
+    MKDIR(benchDir->path);
+
+    const uint64_t sizes[] = {4 * ONE_KB, ONE_MB, 4 * ONE_GB};
+    const char *names[] = {"4 KB", "1 MB", "4 GB"};
+    for (uint32_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+        CopyContext context = {
+                .src = FILE_OF(benchDir, "/src.bin"),
+                .dest = FILE_OF(benchDir, "/dest.bin"),
+                .repeats = sizes[i] >= COPY_BENCH_MIN_BYTES ? 1 : (uint32_t) (COPY_BENCH_MIN_BYTES / sizes[i] / 64)
+        };
+        context.repeats = context.repeats > 0 ? context.repeats : 1;
+
+        if (!isEnoughSpaceForCopy(benchDir, sizes[i]) || !createCopySource(context.src, sizes[i])) {
+            printf("%s file: skipped, not enough space in '%s'\n", names[i], benchDir->path);
+            continue;
+        }
+
+        printf("%s file, %u copies:\n", names[i], context.repeats);
+        reportCopy("fgetc()/fputc() loop", runCopyByChars, &context, sizes[i]);
+        reportCopy("copyFile()", runCopyFile, &context, sizes[i]);
+        printf("  copyFileWithMode() strategy: %s\n", copyStrategyNames[copyFileWithMode(context.src, context.dest, COPY_MODE_CLONE_OR_COPY)]);
+        remove(context.dest->path);
+        remove(context.src->path);
+    }
+
+    reportSparseCopy(benchDir);
+    deleteDirectory(benchDir);
+}
+
+#define DELTA_COPY_BENCH_FILE_SIZE (256 * ONE_MB)
+#define DELTA_COPY_BENCH_CHANGES 8
+
+typedef struct DeltaCopyContext {
+    CopyContext copy;
+    DeltaCopyStats stats;
+} DeltaCopyContext;
+
+static void runCopyFileDelta(void *context) {
+    DeltaCopyContext *delta = context;
+    copyFileDelta(delta->copy.src, delta->copy.dest, 0, &delta->stats);
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static void changeDeltaSource(File *file) {     // one byte in few blocks, like updated records of database file
+    int fd = open(file->path, O_WRONLY);
+    if (fd == -1) return;
+    for (uint32_t i = 0; i < DELTA_COPY_BENCH_CHANGES; i++) {
+        uint64_t offset = (DELTA_COPY_BENCH_FILE_SIZE / DELTA_COPY_BENCH_CHANGES) * i + i * 4099;
+        pwrite(fd, "?", 1, (off_t) offset);
+    }
+    close(fd);
+}
+#endif
+
+static void benchmarkDeltaCopy(const char *workDir) {
+    File *benchDir = FILE_OF(NEW_FILE(workDir), "/delta_copy");
+    deleteDirectory(benchDir);
+    createSubDirs(benchDir);
+    MKDIR(benchDir->path);
+
+    DeltaCopyContext context = {.copy = {.src = FILE_OF(benchDir, "/src.bin"), .dest = FILE_OF(benchDir, "/dest.bin"), .repeats = 1}};
+    if (!isEnoughSpaceForCopy(benchDir, DELTA_COPY_BENCH_FILE_SIZE) || !createCopySource(context.copy.src, DELTA_COPY_BENCH_FILE_SIZE)) {
+        printf("Delta copy: skipped, not enough space in '%s'\n", benchDir->path);
+        return;
+    }
+
+    printf("256 MB file, %u changed blocks:\n", DELTA_COPY_BENCH_CHANGES);
+    copyFileWithMode(context.copy.src, context.copy.dest, COPY_MODE_ALWAYS_COPY);
+#if !defined(_WIN32) && !defined(_WIN64)
+    changeDeltaSource(context.copy.src);
+#endif
+    reportCopy("copyFileDelta()", runCopyFileDelta, (CopyContext *) &context, DELTA_COPY_BENCH_FILE_SIZE);
+    printf("  transferred: %.1f KB in %u blocks, skipped: %.1f MB\n", (double) context.stats.bytesTransferred / ONE_KB,
+           context.stats.blocksTransferred, (double) context.stats.bytesSkipped / ONE_MB);
+    reportCopy("copyFile()", runCopyFile, &context.copy, DELTA_COPY_BENCH_FILE_SIZE);
+    deleteDirectory(benchDir);
+}
+
+#define DIR_COPY_BENCH_DIR_COUNT 40
+#define DIR_COPY_BENCH_FILES_PER_DIR 100
+#define DIR_COPY_BENCH_FILE_SIZE (16 * ONE_KB)
+
+typedef struct DirCopyContext {
+    File *srcDir;
+    File *destDir;
+    uint32_t threads;
+} DirCopyContext;
+
+static void runCopyDirectory(void *context) {
+    DirCopyContext *copy = context;
+#ifdef FILE_UTILS_ENABLE_THREADS
+    if (copy->threads > 1) {
+        copyDirectoryParallel(copy->srcDir, copy->destDir, copy->threads);
+        return;
+    }
+#endif
+    copyDirectory(copy->srcDir, copy->destDir);
+}
+
+static void reportDirCopy(DirCopyContext *context) {
+    deleteDirectory(context->destDir);
+    MKDIR(context->destDir->path);
+    double seconds = measureSeconds(runCopyDirectory, context);
+    uint32_t fileCount = DIR_COPY_BENCH_DIR_COUNT * DIR_COPY_BENCH_FILES_PER_DIR;
+    printf("%s x%-3u files: %-6u %8.3f ms  %8.0f files/s  %7.1f MB/s\n",
+           context->threads > 1 ? "copyDirectoryParallel()" : "copyDirectory()        ", context->threads, fileCount,
+           seconds * 1e3, fileCount / seconds, (double) fileCount * DIR_COPY_BENCH_FILE_SIZE / seconds / ONE_MB);
+}
+
+static void benchmarkDirCopy(const char *workDir) {
+    File *benchDir = FILE_OF(NEW_FILE(workDir), "/dir_copy");
+    deleteDirectory(benchDir);
+    createSubDirs(benchDir);
+    MKDIR(benchDir->path);
+
+    DirCopyContext context = {.srcDir = FILE_OF(benchDir, "/src"), .destDir = FILE_OF(benchDir, "/dest"), .threads = 1};
+    MKDIR(context.srcDir->path);
+    for (uint32_t i = 0; i < DIR_COPY_BENCH_DIR_COUNT; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "/dir_%u", i);
+        File *dir = FILE_OF(context.srcDir, name);
+        MKDIR(dir->path);
+        for (uint32_t j = 0; j < DIR_COPY_BENCH_FILES_PER_DIR; j++) {
+            snprintf(name, sizeof(name), "/file_%u.bin", j);
+            createCopySource(FILE_OF(dir, name), DIR_COPY_BENCH_FILE_SIZE);
+        }
+    }
+
+    reportDirCopy(&context);
+#ifdef FILE_UTILS_ENABLE_THREADS
+    uint32_t threadCounts[] = {2, 4, 8, 16};
+    for (uint32_t i = 0; i < ARRAY_SIZE(threadCounts); i++) {
+        context.threads = threadCounts[i];
+        reportDirCopy(&context);
+    }
+#endif
+    deleteDirectory(benchDir);
+}
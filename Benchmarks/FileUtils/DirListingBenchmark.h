@@ -0,0 +1,188 @@
+#pragma once
+
+#include "BaseBenchmarkTemplate.h"
+#include "FileUtils.h"
+
+#define LISTING_BENCH_DIR_COUNT 20
+#define LISTING_BENCH_FILES_PER_DIR 500
+#define LISTING_BENCH_ENTRY_COUNT (LISTING_BENCH_DIR_COUNT * (LISTING_BENCH_FILES_PER_DIR + 1))
+#define FLAT_DIR_BENCH_FILE_COUNT 100000
+#define FLAT_DIR_BENCH_BUFFER_SIZE ONE_MB
+
+typedef struct ListingContext {
+    File *rootDir;
+    fileVector *vec;
+} ListingContext;
+
+
+// Reference walker with the stat() per entry approach: isDirectory() + isDirExists() for root, isFile() and isDirectory() for each entry
+static void statPerEntryWalk(File *directory, fileVector *vec) {
+    if (!isDirectory(directory) || !isDirExists(directory)) {
+        return;
+    }
+
+    DIR *dir = opendir(directory->path);
+    if (dir == NULL) return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+
+        File *child = FILE_OF(directory, entry->d_name);
+        if (isFile(child) && vec->size < vec->capacity) {
+            vec->items[vec->size++] = *child;
+        }
+
+        if (isDirectory(child)) {
+            statPerEntryWalk(child, vec);
+        }
+    }
+    closedir(dir);
+}
+
+static void runStatPerEntryWalk(void *context) {
+    ListingContext *listing = context;
+    fileVecClear(listing->vec);
+    statPerEntryWalk(listing->rootDir, listing->vec);
+}
+
+static void runListFiles(void *context) {
+    ListingContext *listing = context;
+    fileVecClear(listing->vec);
+    listFiles(listing->rootDir, listing->vec, true);
+}
+
+#ifdef FILE_UTILS_ENABLE_THREADS
+typedef struct ParallelListingContext {
+    File *rootDir;
+    fileVector *vec;
+    uint32_t threads;
+} ParallelListingContext;
+
+static void runListFilesParallel(void *context) {
+    ParallelListingContext *listing = context;
+    fileVecClear(listing->vec);
+    listFilesParallelToVec(listing->rootDir, listing->vec, listing->threads, false);
+}
+
+static void reportParallelListing(File *rootDir, fileVector *vec) {
+    uint32_t threadCounts[] = {1, 2, 4, 8, 16};
+    double singleThreadSeconds = 0;
+    for (uint32_t i = 0; i < ARRAY_SIZE(threadCounts); i++) {
+        ParallelListingContext context = {.rootDir = rootDir, .vec = vec, .threads = threadCounts[i]};
+        runListFilesParallel(&context);
+        double seconds = measureSeconds(runListFilesParallel, &context);
+        singleThreadSeconds = i == 0 ? seconds : singleThreadSeconds;
+        printf("listFilesParallel() x%-7u files: %-8u %8.3f ms  speedup: %.2fx\n",
+               threadCounts[i], fileVecSize(vec), seconds * 1e3, singleThreadSeconds / seconds);
+    }
+}
+#endif
+
+static void createListingTree(File *rootDir) {
+    deleteDirectory(rootDir);
+    for (uint32_t i = 0; i < LISTING_BENCH_DIR_COUNT; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "dir_%u", i);
+        File *subDir = FILE_OF(rootDir, name);
+        createSubDirs(subDir);
+        MKDIR(subDir->path);
+
+        for (uint32_t j = 0; j < LISTING_BENCH_FILES_PER_DIR; j++) {
+            snprintf(name, sizeof(name), "file_%u.txt", j);
+            createFile(FILE_OF(subDir, name));
+        }
+    }
+}
+
+static void reportListing(const char *name, BenchmarkFunction function, ListingContext *context) {
+    function(context);  // warm dentry cache
+    double seconds = measureSeconds(function, context);
+    long syscalls = countSyscalls(function, context);
+    uint32_t entries = LISTING_BENCH_ENTRY_COUNT;
+
+    printf("%-28s files: %-8u %8.3f ms  %8.1f ns/entry", name, fileVecSize(context->vec), seconds * 1e3, seconds * 1e9 / entries);
+    if (syscalls == NOT_AVAILABLE) {
+        printf("  syscalls/entry: n/a (run under 'strace -c -f')\n");
+    } else {
+        printf("  syscalls/entry: %.2f\n", (double) syscalls / entries);
+    }
+}
+
+static void benchmarkDirListing(const char *workDir) {
+    File *rootDir = FILE_OF(NEW_FILE(workDir), "listing");
+    createListingTree(rootDir);
+
+    fileVector *vec = NEW_VECTOR_BUFF(File, file, calloc(LISTING_BENCH_ENTRY_COUNT, sizeof(File)), LISTING_BENCH_ENTRY_COUNT);
+    ListingContext context = {.rootDir = rootDir, .vec = vec};
+
+    reportListing("stat() per entry", runStatPerEntryWalk, &context);
+    reportListing("listFiles()", runListFiles, &context);
+#ifdef FILE_UTILS_ENABLE_THREADS
+    reportParallelListing(rootDir, vec);
+#endif
+
+    free(vec->items);
+    deleteDirectory(rootDir);
+}
+
+typedef struct FlatDirContext {
+    File *dir;
+    char *buffer;
+    uint32_t bufferSize;
+    uint32_t entryCount;
+} FlatDirContext;
+
+static void runReaddirLoop(void *context) {
+    FlatDirContext *flatDir = context;
+    flatDir->entryCount = 0;
+    DIR *dir = opendir(flatDir->dir->path);
+    while (readdir(dir) != NULL) {
+        flatDir->entryCount++;
+    }
+    closedir(dir);
+}
+
+static void runFileIterator(void *context) {
+    FlatDirContext *flatDir = context;
+    flatDir->entryCount = 0;
+    FileIterator iterator;
+    openFileIteratorBuffered(&iterator, flatDir->dir, false, flatDir->buffer, flatDir->bufferSize);
+    while (nextFileOrDir(&iterator) != NULL) {
+        flatDir->entryCount++;
+    }
+    closeFileIterator(&iterator);
+}
+
+static void reportFlatDir(const char *name, BenchmarkFunction function, FlatDirContext *context) {
+    function(context);
+    double seconds = measureSeconds(function, context);
+    long syscalls = countSyscalls(function, context);
+    printf("%-28s entries: %-8u %8.3f ms  %10.0f entries/s", name, context->entryCount, seconds * 1e3, context->entryCount / seconds);
+    if (syscalls == NOT_AVAILABLE) {
+        printf("\n");
+    } else {
+        printf("  syscalls: %ld\n", syscalls);
+    }
+}
+
+static void benchmarkFlatDirListing(const char *workDir) {
+    File *dir = FILE_OF(NEW_FILE(workDir), "flat");
+    deleteDirectory(dir);
+    createSubDirs(dir);
+    MKDIR(dir->path);
+    for (uint32_t i = 0; i < FLAT_DIR_BENCH_FILE_COUNT; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "spool_file_%07u.dat", i);
+        createFile(FILE_OF(dir, name));
+    }
+
+    FlatDirContext context = {.dir = dir, .buffer = malloc(FLAT_DIR_BENCH_BUFFER_SIZE)};
+    reportFlatDir("readdir() loop", runReaddirLoop, &context);
+    reportFlatDir("FileIterator", runFileIterator, &context);
+    context.bufferSize = FLAT_DIR_BENCH_BUFFER_SIZE;
+    reportFlatDir("FileIterator, 1 MB batches", runFileIterator, &context);
+
+    free(context.buffer);
+    deleteDirectory(dir);
+}
@@ -0,0 +1,427 @@
+#pragma once
+
+#include "BaseBenchmarkTemplate.h"
+#include "FileUtils.h"
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    #include <fcntl.h>
+#endif
+
+#ifdef FILE_UTILS_ENABLE_THREADS
+    #include <pthread.h>
+#endif
+
+#define BATCH_READ_BENCH_FILE_COUNT 2000
+#define BATCH_READ_BENCH_FILE_SIZE (4 * ONE_KB)
+#define BATCH_READ_BENCH_QUEUE_DEPTH 256
+
+#define APPEND_BENCH_RECORD_COUNT 20000
+#define GROUP_COMMIT_BENCH_RECORD_COUNT 4000
+#define GROUP_COMMIT_BENCH_THREADS 8
+
+#define ATOMIC_WRITE_BENCH_COUNT 200
+#define ATOMIC_WRITE_BENCH_FILE_SIZE (4 * ONE_KB)
+
+#define FILE_VIEW_BENCH_FILE_SIZE (64 * ONE_MB)
+#define FILE_VIEW_BENCH_PASSES 10
+
+static const char *fileOpEngineNames[] = {"auto", "io_uring", "threads", "sync"};
+
+typedef struct AppendContext {
+    File *file;
+    BufferString **parts;   // APPEND_BENCH_RECORD_COUNT records
+    uint64_t written;
+} AppendContext;
+
+typedef struct AtomicWriteContext {
+    File *file;
+    char *data;             // ATOMIC_WRITE_BENCH_FILE_SIZE
+    WriteDurability durability;
+    bool isAtomic;          // or truncate and write in place
+    uint32_t failedCount;
+} AtomicWriteContext;
+
+typedef struct FileViewContext {
+    File *file;
+    char *buffer;           // FILE_VIEW_BENCH_FILE_SIZE + 1
+    FileViewHint hint;
+    bool isPopulated;
+    uint64_t sum;           // keeps data reads from being optimized out
+} FileViewContext;
+
+typedef struct BatchReadContext {
+    File *files;
+    char *buffers;          // BATCH_READ_BENCH_FILE_SIZE + 1 per file
+    FileOpEngine engine;
+    uint32_t readCount;
+} BatchReadContext;
+
+
+static void runReadFileToBuffer(void *context) {
+    BatchReadContext *batch = context;
+    batch->readCount = 0;
+    for (uint32_t i = 0; i < BATCH_READ_BENCH_FILE_COUNT; i++) {
+        char *buffer = batch->buffers + i * (BATCH_READ_BENCH_FILE_SIZE + 1);
+        batch->readCount += readFileToBuffer(&batch->files[i], buffer, BATCH_READ_BENCH_FILE_SIZE + 1) == BATCH_READ_BENCH_FILE_SIZE;
+    }
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+// Each file goes open -> read -> close, next step is submitted when previous one completes
+static void runQueuedReads(void *context) {
+    BatchReadContext *batch = context;
+    batch->readCount = 0;
+    FileOpQueue queue;
+    FileOp *ops = calloc(BATCH_READ_BENCH_FILE_COUNT, sizeof(FileOp));
+    if (ops == NULL || !openFileOpQueue(&queue, BATCH_READ_BENCH_QUEUE_DEPTH, batch->engine)) {
+        free(ops);
+        return;
+    }
+
+    uint32_t nextFile = 0;
+    while (nextFile < BATCH_READ_BENCH_FILE_COUNT || queue.inFlight > 0) {
+        while (nextFile < BATCH_READ_BENCH_FILE_COUNT && queue.inFlight < queue.depth) {
+            ops[nextFile] = (FileOp) {.type = FILE_OP_OPEN, .path = batch->files[nextFile].path, .flags = O_RDONLY | O_CLOEXEC};
+            submitFileOp(&queue, &ops[nextFile]);
+            nextFile++;
+        }
+
+        FileOp *op = waitFileOp(&queue);    // submits steps added since last wait
+        if (op == NULL) break;
+        for (; op != NULL; op = pollFileOp(&queue)) {
+            uint32_t index = op - ops;
+            if (op->type == FILE_OP_OPEN && op->result >= 0) {
+                *op = (FileOp) {.type = FILE_OP_READ, .fd = (int) op->result, .buffer = batch->buffers + index * (BATCH_READ_BENCH_FILE_SIZE + 1), .length = BATCH_READ_BENCH_FILE_SIZE};
+                submitFileOp(&queue, op);
+            } else if (op->type == FILE_OP_READ) {
+                batch->readCount += op->result == BATCH_READ_BENCH_FILE_SIZE;
+                *op = (FileOp) {.type = FILE_OP_CLOSE, .fd = op->fd};
+                submitFileOp(&queue, op);
+            }
+        }
+    }
+    closeFileOpQueue(&queue);
+    free(ops);
+}
+#endif
+
+static void reportBatchRead(const char *name, BenchmarkFunction function, BatchReadContext *context) {
+    double seconds = measureSeconds(function, context);
+    printf("  %-24s %8.3f ms  %8.0f files/s  read: %u", name, seconds * 1e3, BATCH_READ_BENCH_FILE_COUNT / seconds, context->readCount);
+
+    long syscalls = countSyscalls(function, context);
+    if (syscalls == NOT_AVAILABLE) {
+        printf("\n");
+    } else {
+        printf("  syscalls/file: %.2f\n", (double) syscalls / BATCH_READ_BENCH_FILE_COUNT);
+    }
+}
+
+static void benchmarkBatchRead(const char *workDir) {
+    File *benchDir = FILE_OF(NEW_FILE(workDir), "/batch_read");
+    deleteDirectory(benchDir);
+    createSubDirs(benchDir);
+    MKDIR(benchDir->path);
+
+    BatchReadContext context = {
+            .files = calloc(BATCH_READ_BENCH_FILE_COUNT, sizeof(File)),
+            .buffers = malloc(BATCH_READ_BENCH_FILE_COUNT * (BATCH_READ_BENCH_FILE_SIZE + 1))
+    };
+    char *content = malloc(BATCH_READ_BENCH_FILE_SIZE);
+    if (context.files == NULL || context.buffers == NULL || content == NULL) {
+        printf("Batch read: skipped, not enough memory\n");
+        free(context.files);
+        free(context.buffers);
+        free(content);
+        return;
+    }
+    memset(content, 'x', BATCH_READ_BENCH_FILE_SIZE);
+    for (uint32_t i = 0; i < BATCH_READ_BENCH_FILE_COUNT; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "/file_%u.bin", i);
+        newFileFromParent(&context.files[i], benchDir, name);
+        createFile(&context.files[i]);
+        writeCharsToFile(&context.files[i], content, BATCH_READ_BENCH_FILE_SIZE, false);
+    }
+
+    printf("%u files of %llu KB, page cache is warm:\n", BATCH_READ_BENCH_FILE_COUNT, BATCH_READ_BENCH_FILE_SIZE / ONE_KB);
+    runReadFileToBuffer(&context);
+    reportBatchRead("readFileToBuffer()", runReadFileToBuffer, &context);
+#if !defined(_WIN32) && !defined(_WIN64)
+    FileOpEngine engines[] = {FILE_OP_ENGINE_IO_URING, FILE_OP_ENGINE_THREADS, FILE_OP_ENGINE_SYNC};
+    for (uint32_t i = 0; i < ARRAY_SIZE(engines); i++) {
+        FileOpQueue queue;
+        if (!openFileOpQueue(&queue, BATCH_READ_BENCH_QUEUE_DEPTH, engines[i])) {
+            printf("  queue %-18s not available\n", fileOpEngineNames[engines[i]]);
+            continue;
+        }
+        closeFileOpQueue(&queue);
+
+        char name[64];
+        snprintf(name, sizeof(name), "queue %s x%u", fileOpEngineNames[engines[i]], BATCH_READ_BENCH_QUEUE_DEPTH);
+        context.engine = engines[i];
+        reportBatchRead(name, runQueuedReads, &context);
+    }
+#endif
+
+    free(context.files);
+    free(context.buffers);
+    free(content);
+    deleteDirectory(benchDir);
+}
+
+static uint64_t sumFileBytes(const char *data, uint64_t length) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < length; i += 64) {     // one byte per cache line, data access cost is the same for both
+        sum += (uint8_t) data[i];
+    }
+    return sum;
+}
+
+static void runReadWholeFile(void *context) {
+    FileViewContext *view = context;
+    view->sum = 0;
+    for (uint32_t i = 0; i < FILE_VIEW_BENCH_PASSES; i++) {
+        uint32_t length = readFileToBuffer(view->file, view->buffer, FILE_VIEW_BENCH_FILE_SIZE + 1);
+        view->sum += sumFileBytes(view->buffer, length);
+    }
+}
+
+static void runFileView(void *context) {
+    FileViewContext *view = context;
+    view->sum = 0;
+    for (uint32_t i = 0; i < FILE_VIEW_BENCH_PASSES; i++) {
+        FileView fileView;
+        if (!openFileView(view->file, &fileView, view->hint, view->isPopulated)) return;
+        view->sum += sumFileBytes(fileView.data, fileView.length);
+        closeFileView(&fileView);
+    }
+}
+
+static void reportFileView(const char *name, BenchmarkFunction function, FileViewContext *context) {
+    double seconds = measureSeconds(function, context);
+    double megabytes = (double) FILE_VIEW_BENCH_FILE_SIZE * FILE_VIEW_BENCH_PASSES / ONE_MB;
+    printf("  %-28s %8.3f ms  %8.1f MB/s", name, seconds * 1e3, megabytes / seconds);
+
+    long syscalls = countSyscalls(function, context);
+    if (syscalls == NOT_AVAILABLE) {
+        printf("\n");
+    } else {
+        printf("  syscalls/pass: %.1f\n", (double) syscalls / FILE_VIEW_BENCH_PASSES);
+    }
+}
+
+static void benchmarkFileView(const char *workDir) {
+    File *benchDir = FILE_OF(NEW_FILE(workDir), "/file_view");
+    deleteDirectory(benchDir);
+    createSubDirs(benchDir);
+    MKDIR(benchDir->path);
+
+    FileViewContext context = {.file = FILE_OF(benchDir, "/data.bin"), .buffer = malloc(FILE_VIEW_BENCH_FILE_SIZE + 1)};
+    char *content = malloc(ONE_MB);
+    if (context.buffer == NULL || content == NULL) {
+        printf("File view: skipped, not enough memory\n");
+        free(context.buffer);
+        free(content);
+        return;
+    }
+    for (uint32_t i = 0; i < ONE_MB; i++) {
+        content[i] = (char) (i * 31);
+    }
+    createFile(context.file);
+    for (uint32_t i = 0; i < FILE_VIEW_BENCH_FILE_SIZE / ONE_MB; i++) {
+        writeCharsToFile(context.file, content, ONE_MB, true);
+    }
+
+    printf("%u passes over %llu MB file, page cache is warm:\n", FILE_VIEW_BENCH_PASSES, FILE_VIEW_BENCH_FILE_SIZE / ONE_MB);
+    runReadWholeFile(&context);
+    reportFileView("readFileToBuffer()", runReadWholeFile, &context);
+    reportFileView("openFileView()", runFileView, &context);
+    context.hint = FILE_VIEW_HINT_SEQUENTIAL;
+    reportFileView("openFileView() sequential", runFileView, &context);
+    context.hint = FILE_VIEW_HINT_NONE;
+    context.isPopulated = true;
+    reportFileView("openFileView() populated", runFileView, &context);
+
+    free(context.buffer);
+    free(content);
+    deleteDirectory(benchDir);
+}
+
+static const char appendBenchRecord[] = "2024-01-01T00:00:00Z INFO request handled in 12 ms\n";
+
+static void runAppendByWriteChars(void *context) {
+    AppendContext *append = context;
+    writeCharsToFile(append->file, "", 0, false);   // truncate
+    append->written = 0;
+    for (uint32_t i = 0; i < APPEND_BENCH_RECORD_COUNT; i++) {
+        append->written += writeCharsToFile(append->file, appendBenchRecord, sizeof(appendBenchRecord) - 1, true);
+    }
+}
+
+static void runAppendByHandle(void *context) {
+    AppendContext *append = context;
+    append->written = 0;
+    if (!openFileHandle(append->file, FILE_HANDLE_WRITE)) return;
+    for (uint32_t i = 0; i < APPEND_BENCH_RECORD_COUNT; i++) {
+        append->written += writeFileHandle(append->file, appendBenchRecord, sizeof(appendBenchRecord) - 1);
+    }
+    closeFileHandle(append->file);
+}
+
+static void runAppendByStrings(void *context) {
+    AppendContext *append = context;
+    append->written = writeStringsToFile(append->file, append->parts, APPEND_BENCH_RECORD_COUNT, false);
+}
+
+static void reportAppend(const char *name, BenchmarkFunction function, AppendContext *context) {
+    double seconds = measureSeconds(function, context);
+    printf("  %-24s %8.3f ms  %10.0f records/s  written: %llu", name, seconds * 1e3, APPEND_BENCH_RECORD_COUNT / seconds, (unsigned long long) context->written);
+
+    long syscalls = countSyscalls(function, context);
+    if (syscalls == NOT_AVAILABLE) {
+        printf("\n");
+    } else {
+        printf("  syscalls/record: %.2f\n", (double) syscalls / APPEND_BENCH_RECORD_COUNT);
+    }
+}
+
+static void benchmarkAppendRecords(const char *workDir) {
+    File *benchDir = FILE_OF(NEW_FILE(workDir), "/append_records");
+    deleteDirectory(benchDir);
+    createSubDirs(benchDir);
+    MKDIR(benchDir->path);
+
+    AppendContext context = {.file = FILE_OF(benchDir, "/journal.log")};
+    createFile(context.file);
+    printf("%u records of %zu bytes:\n", APPEND_BENCH_RECORD_COUNT, sizeof(appendBenchRecord) - 1);
+    reportAppend("writeCharsToFile()", runAppendByWriteChars, &context);
+    reportAppend("writeFileHandle()", runAppendByHandle, &context);
+
+    BufferString record = {.value = (char *) appendBenchRecord, .length = sizeof(appendBenchRecord) - 1, .capacity = sizeof(appendBenchRecord)};
+    context.parts = malloc(APPEND_BENCH_RECORD_COUNT * sizeof(BufferString *));
+    if (context.parts != NULL) {
+        for (uint32_t i = 0; i < APPEND_BENCH_RECORD_COUNT; i++) {
+            context.parts[i] = &record;
+        }
+        reportAppend("writeStringsToFile()", runAppendByStrings, &context);
+        free(context.parts);
+    }
+    deleteDirectory(benchDir);
+}
+
+static void runAtomicWrite(void *context) {
+    AtomicWriteContext *atomic = context;
+    atomic->failedCount = 0;
+    for (uint32_t i = 0; i < ATOMIC_WRITE_BENCH_COUNT; i++) {
+        bool isWritten = atomic->isAtomic ?
+                writeCharsToFileAtomic(atomic->file, atomic->data, ATOMIC_WRITE_BENCH_FILE_SIZE, atomic->durability) :
+                writeCharsToFile(atomic->file, atomic->data, ATOMIC_WRITE_BENCH_FILE_SIZE, false) == ATOMIC_WRITE_BENCH_FILE_SIZE;
+        atomic->failedCount += !isWritten;
+    }
+}
+
+static void reportAtomicWrite(const char *name, AtomicWriteContext *context) {
+    double seconds = measureSeconds(runAtomicWrite, context);
+    printf("  %-36s %8.3f ms  %8.3f ms/write  failed: %u\n", name, seconds * 1e3, seconds * 1e3 / ATOMIC_WRITE_BENCH_COUNT, context->failedCount);
+}
+
+static void benchmarkAtomicWrite(const char *workDir) {
+    File *benchDir = FILE_OF(NEW_FILE(workDir), "/atomic_write");
+    deleteDirectory(benchDir);
+    createSubDirs(benchDir);
+    MKDIR(benchDir->path);
+
+    AtomicWriteContext context = {.file = FILE_OF(benchDir, "/config.json"), .data = malloc(ATOMIC_WRITE_BENCH_FILE_SIZE)};
+    if (context.data == NULL) return;
+    memset(context.data, 'c', ATOMIC_WRITE_BENCH_FILE_SIZE);
+    createFile(context.file);
+
+    printf("%u replacements of %llu bytes file:\n", ATOMIC_WRITE_BENCH_COUNT, ATOMIC_WRITE_BENCH_FILE_SIZE);
+    reportAtomicWrite("writeCharsToFile(), in place", &context);
+    context.isAtomic = true;
+    context.durability = WRITE_DURABILITY_NONE;
+    reportAtomicWrite("atomic, WRITE_DURABILITY_NONE", &context);
+    context.durability = WRITE_DURABILITY_DATA;
+    reportAtomicWrite("atomic, WRITE_DURABILITY_DATA", &context);
+    context.durability = WRITE_DURABILITY_FULL;
+    reportAtomicWrite("atomic, WRITE_DURABILITY_FULL", &context);
+    free(context.data);
+    deleteDirectory(benchDir);
+}
+
+#if !defined(_WIN32) && !defined(_WIN64) && defined(FILE_UTILS_ENABLE_THREADS)
+typedef struct GroupCommitContext {
+    File *file;
+    AppendWriter writer;
+    bool isDurableWait;     // each record waits until it's on disk, as transaction commit does
+    uint64_t committed;
+    AppendWriterStats stats;
+} GroupCommitContext;
+
+static void runSyncEachRecord(void *context) {
+    GroupCommitContext *commit = context;
+    commit->committed = 0;
+    commit->stats = (AppendWriterStats) {0};
+    int fd = open(commit->file->path, O_WRONLY | O_TRUNC | O_APPEND | O_CLOEXEC);
+    if (fd == -1) return;
+    for (uint32_t i = 0; i < GROUP_COMMIT_BENCH_RECORD_COUNT; i++) {
+        commit->committed += write(fd, appendBenchRecord, sizeof(appendBenchRecord) - 1) > 0 && fdatasync(fd) == 0;
+    }
+    close(fd);
+}
+
+static void *appendBenchRecords(void *arg) {
+    GroupCommitContext *commit = arg;
+    for (uint32_t i = 0; i < GROUP_COMMIT_BENCH_RECORD_COUNT / GROUP_COMMIT_BENCH_THREADS; i++) {
+        uint64_t position;
+        if (!appendRecord(&commit->writer, appendBenchRecord, sizeof(appendBenchRecord) - 1, &position)) break;
+        if (commit->isDurableWait && !waitAppendDurable(&commit->writer, position)) break;
+    }
+    return NULL;
+}
+
+static void runGroupCommit(void *context) {
+    GroupCommitContext *commit = context;
+    commit->committed = 0;
+    writeCharsToFile(commit->file, "", 0, false);   // truncate
+    if (!openAppendWriter(&commit->writer, commit->file, NULL)) return;
+
+    pthread_t threads[GROUP_COMMIT_BENCH_THREADS];
+    for (uint32_t i = 0; i < GROUP_COMMIT_BENCH_THREADS; i++) {
+        pthread_create(&threads[i], NULL, appendBenchRecords, commit);
+    }
+    for (uint32_t i = 0; i < GROUP_COMMIT_BENCH_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    closeAppendWriter(&commit->writer, &commit->stats);
+    commit->committed = commit->stats.records;
+}
+
+static void reportGroupCommit(const char *name, BenchmarkFunction function, GroupCommitContext *context) {
+    double seconds = measureSeconds(function, context);
+    printf("  %-32s %8.3f ms  %10.0f records/s  committed: %llu", name, seconds * 1e3, context->committed / seconds, (unsigned long long) context->committed);
+    if (context->stats.batches > 0) {
+        printf("  batches: %u, latency avg: %.3f ms, max: %.3f ms", context->stats.batches, context->stats.avgBatchLatency * 1e3, context->stats.maxBatchLatency * 1e3);
+    }
+    printf("\n");
+}
+
+static void benchmarkGroupCommit(const char *workDir) {
+    File *benchDir = FILE_OF(NEW_FILE(workDir), "/group_commit");
+    deleteDirectory(benchDir);
+    createSubDirs(benchDir);
+    MKDIR(benchDir->path);
+
+    GroupCommitContext context = {.file = FILE_OF(benchDir, "/journal.log")};
+    createFile(context.file);
+    printf("%u durable records of %zu bytes, %u appending threads:\n", GROUP_COMMIT_BENCH_RECORD_COUNT, sizeof(appendBenchRecord) - 1, GROUP_COMMIT_BENCH_THREADS);
+    reportGroupCommit("write() + fdatasync() per record", runSyncEachRecord, &context);
+    context.isDurableWait = true;
+    reportGroupCommit("append writer, wait each record", runGroupCommit, &context);
+    context.isDurableWait = false;
+    reportGroupCommit("append writer, no wait", runGroupCommit, &context);
+    deleteDirectory(benchDir);
+}
+#endif
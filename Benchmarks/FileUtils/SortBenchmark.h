@@ -0,0 +1,130 @@
+#pragma once
+
+#include "BaseBenchmarkTemplate.h"
+#include "FileUtils.h"
+
+#define SORT_BENCH_VEC_COUNT 10000      // File items are PATH_MAX_LEN each, keep vector small
+#define SORT_BENCH_LIST_COUNT 200000
+#define SORT_BENCH_LIST_ARENA_SIZE (SORT_BENCH_LIST_COUNT * 64)
+
+typedef struct VecSortContext {
+    fileVector *source;
+    fileVector *vec;
+    uint32_t *order;
+} VecSortContext;
+
+typedef struct ListSortContext {
+    FileList *source;
+    FileList *list;
+    const char **paths;
+} ListSortContext;
+
+
+// Paths in listing order: same deep prefix for all entries, names are unordered as in readdir()
+static uint32_t formatSortBenchPath(char *path, uint32_t index, uint32_t count) {
+    uint32_t shuffled = (uint32_t) (((uint64_t) index * 2654435761u) % count);
+    return sprintf(path, "/tmp/file_utils_bench/sort/dir_%u/sub_%u/file_%07u.txt", shuffled % 16, shuffled % 97, shuffled);
+}
+
+static int comparePathItems(const void *one, const void *two) {
+    return strcmp(((const File *) one)->path, ((const File *) two)->path);
+}
+
+static int comparePathPointers(const void *one, const void *two) {
+    return strcmp(*(const char **) one, *(const char **) two);
+}
+
+static void restoreVec(VecSortContext *context) {
+    memcpy(context->vec->items, context->source->items, context->source->size * sizeof(File));
+    context->vec->size = context->source->size;
+}
+
+static void runVecQsort(void *context) {
+    VecSortContext *sort = context;
+    qsort(sort->vec->items, sort->vec->size, sizeof(File), comparePathItems);
+}
+
+static void runSortFileVector(void *context) {
+    VecSortContext *sort = context;
+    sortFileVector(sort->vec, sort->order);
+}
+
+static void restoreList(ListSortContext *context) {
+    FileList *source = context->source;
+    FileList *list = context->list;
+    memcpy(list->pathOffsets, source->pathOffsets, source->size * sizeof(uint32_t));
+    memcpy(list->pathLengths, source->pathLengths, source->size * sizeof(uint16_t));
+    memcpy(list->types, source->types, source->size * sizeof(uint8_t));
+    memcpy(list->pathArena, source->pathArena, source->arenaLength);
+    list->size = source->size;
+    list->arenaLength = source->arenaLength;
+}
+
+static void runListQsort(void *context) {
+    ListSortContext *sort = context;
+    for (uint32_t i = 0; i < sort->list->size; i++) {
+        sort->paths[i] = fileListPath(sort->list, i);
+    }
+    qsort(sort->paths, sort->list->size, sizeof(const char *), comparePathPointers);
+}
+
+static void runSortFileList(void *context) {
+    ListSortContext *sort = context;
+    sortFileList(sort->list);
+}
+
+static void reportSort(const char *name, uint32_t count, double seconds) {
+    printf("%-28s paths: %-8u %8.3f ms  %8.1f ns/path\n", name, count, seconds * 1e3, seconds * 1e9 / count);
+}
+
+static void benchmarkSortedListing(const char *workDir) {
+    File *sourceItems = malloc(SORT_BENCH_VEC_COUNT * sizeof(File));
+    File *items = malloc(SORT_BENCH_VEC_COUNT * sizeof(File));
+    uint32_t *order = malloc(SORT_BENCH_VEC_COUNT * sizeof(uint32_t));
+    uint32_t listBufferSize = FILE_LIST_BUFFER_SIZE(SORT_BENCH_LIST_COUNT, SORT_BENCH_LIST_ARENA_SIZE);
+    char *sourceListBuffer = malloc(listBufferSize);
+    char *listBuffer = malloc(listBufferSize);
+    const char **paths = malloc(SORT_BENCH_LIST_COUNT * sizeof(const char *));
+    if (sourceItems == NULL || items == NULL || order == NULL || sourceListBuffer == NULL || listBuffer == NULL || paths == NULL) {
+        printf("Not enough memory for sort benchmark\n");
+        free(sourceItems), free(items), free(order), free(sourceListBuffer), free(listBuffer), free(paths);
+        return;
+    }
+
+    VecSortContext vecContext = {
+            .source = NEW_VECTOR_BUFF(File, file, sourceItems, SORT_BENCH_VEC_COUNT),
+            .vec = NEW_VECTOR_BUFF(File, file, items, SORT_BENCH_VEC_COUNT),
+            .order = order
+    };
+    for (uint32_t i = 0; i < SORT_BENCH_VEC_COUNT; i++) {
+        File *item = &sourceItems[i];
+        item->file = NULL;
+        item->dir = NULL;
+        item->pathLength = formatSortBenchPath(item->path, i, SORT_BENCH_VEC_COUNT);
+    }
+    vecContext.source->size = SORT_BENCH_VEC_COUNT;
+
+    FileList source, list;
+    ListSortContext listContext = {
+            .source = newFileList(&source, sourceListBuffer, listBufferSize, SORT_BENCH_LIST_COUNT),
+            .list = newFileList(&list, listBuffer, listBufferSize, SORT_BENCH_LIST_COUNT),
+            .paths = paths
+    };
+    for (uint32_t i = 0; i < SORT_BENCH_LIST_COUNT; i++) {
+        char path[128];
+        uint32_t length = formatSortBenchPath(path, i, SORT_BENCH_LIST_COUNT);
+        addToFileList(listContext.source, path, length, FILE_TYPE_REGULAR);
+    }
+
+    restoreVec(&vecContext);
+    reportSort("qsort(fileVector)", SORT_BENCH_VEC_COUNT, measureSeconds(runVecQsort, &vecContext));
+    restoreVec(&vecContext);
+    reportSort("sortFileVector()", SORT_BENCH_VEC_COUNT, measureSeconds(runSortFileVector, &vecContext));
+
+    restoreList(&listContext);
+    reportSort("qsort(FileList paths)", SORT_BENCH_LIST_COUNT, measureSeconds(runListQsort, &listContext));
+    restoreList(&listContext);
+    reportSort("sortFileList()", SORT_BENCH_LIST_COUNT, measureSeconds(runSortFileList, &listContext));
+
+    free(sourceItems), free(items), free(order), free(sourceListBuffer), free(listBuffer), free(paths);
+}
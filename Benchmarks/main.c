@@ -0,0 +1,34 @@
+#include "FileUtils/DirListingBenchmark.h"
+#include "FileUtils/SortBenchmark.h"
+#include "FileUtils/CopyBenchmark.h"
+#include "FileUtils/FileOpBenchmark.h"
+
+// Usage: ./Benchmarks [work dir] [benchmark name]
+int main(int argc, char *argv[]) {
+    const char *workDir = argc > 1 ? argv[1] : "/tmp/file_utils_bench";
+    const char *filter = argc > 2 ? argv[2] : NULL;
+
+    Benchmark benchmarks[] = {
+            {.name = "dir_listing", .run = benchmarkDirListing},
+            {.name = "flat_dir_listing", .run = benchmarkFlatDirListing},
+            {.name = "sorted_listing", .run = benchmarkSortedListing},
+            {.name = "file_copy", .run = benchmarkFileCopy},
+            {.name = "delta_copy", .run = benchmarkDeltaCopy},
+            {.name = "dir_copy", .run = benchmarkDirCopy},
+            {.name = "batch_read", .run = benchmarkBatchRead},
+            {.name = "file_view", .run = benchmarkFileView},
+            {.name = "append_records", .run = benchmarkAppendRecords},
+            {.name = "atomic_write", .run = benchmarkAtomicWrite},
+#if !defined(_WIN32) && !defined(_WIN64) && defined(FILE_UTILS_ENABLE_THREADS)
+            {.name = "group_commit", .run = benchmarkGroupCommit},
+#endif
+    };
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(benchmarks); i++) {
+        if (filter == NULL || strcmp(filter, benchmarks[i].name) == 0) {
+            printf("=== %s ===\n", benchmarks[i].name);
+            benchmarks[i].run(workDir);
+        }
+    }
+    return 0;
+}
@@ -1,6 +1,51 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE     // SEEK_DATA and SEEK_HOLE for sparse file copy
+#endif
+
+#if !defined(_FILE_OFFSET_BITS)
+    #define _FILE_OFFSET_BITS 64    // 64-bit off_t, stat() and fopen() of files over 2 GB on 32-bit systems
+#endif
+
 #include "FileUtils.h"
 
+#if defined(_WIN32) || defined(_WIN64)
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/uio.h>
+#endif
+
+#if defined(__linux__)
+    #include <sys/syscall.h>
+    #include <sys/inotify.h>
+    #include <sys/sendfile.h>
+    #include <sys/ioctl.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include) && !defined(IGNORE_IO_URING)
+    #if __has_include(<linux/io_uring.h>)
+        #include <linux/io_uring.h>
+        #include <sys/sysmacros.h>
+        #if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(STATX_BASIC_STATS)
+            #define USE_IO_URING    // raw syscalls, kernel support is checked when queue is opened
+        #endif
+    #endif
+#endif
+
+#ifdef FILE_UTILS_ENABLE_THREADS
+    #include <pthread.h>
+#endif
+
 #define NO_FILE_INFO (-1)
+
+#if defined(IOV_MAX)
+    #define WRITE_VECTORS_MAX IOV_MAX
+#else
+    #define WRITE_VECTORS_MAX 1024  // POSIX minimum is 16, Linux and macOS allow 1024
+#endif
+#define ATOMIC_WRITE_NAME_ATTEMPTS 16
 #define MULTIPLE_PATH_SEPARATORS FILE_NAME_SEPARATOR_STR FILE_NAME_SEPARATOR_STR
 
 #if defined(_WIN32) || defined(_WIN64)
@@ -15,15 +60,364 @@
     #define PATH_SEPARATOR_TO_REPLACE ":"
 #endif
 
-static File fileBuffer[MAX_FILES_IN_DIR] = {0};
+typedef enum WalkEvent {
+    WALK_END,
+    WALK_ENTRY,         // file or directory found, directory contents follows it when walk is recursive
+    WALK_DIR_EXIT       // all directory contents has been visited
+} WalkEvent;
+
+// Paths sorted by multikey quicksort: partitioning is done by single char at current depth, so shared
+// directory prefixes are compared once per partition instead of for each comparison
+typedef struct PathSort {
+    FileList *list;     // sort list entries
+    fileVector *vec;    // or vector item indexes from 'order'
+    uint32_t *order;
+} PathSort;
+
+#define PATH_SORT_INSERTION_THRESHOLD 12
+
+struct DirCacheRecord {
+    char *data;             // directory path, then each child as type byte and NUL terminated name
+    uint32_t pathLength;
+    uint32_t dataLength;
+    uint32_t dataCapacity;
+    uint32_t childCount;
+    uint32_t hash;
+    uint64_t device;
+    uint64_t inode;
+    int64_t modifiedSeconds;
+    int64_t modifiedNanos;
+    int64_t readTime;
+};
+
+typedef struct CachedWalk {
+    DirCache *cache;
+    fileVector *vec;
+    bool recursive;
+    bool includeDirs;
+    File dir;               // path of the directory being listed
+} CachedWalk;
+
+#define DIR_CACHE_MIN_SLOTS 64
+
+#define FILE_COPY_CHUNK_SIZE (1024 * 1024 * 1024)    // max length for single in-kernel copy call
+
+// Progress of single copy call, all copy functions accept NULL tracker
+typedef struct CopyTracker {
+    CopyProgressOptions *options;
+    CopyProgress progress;
+    uint64_t syscalls;
+    uint64_t nextCallbackBytes;
+    uint32_t nextCallbackFiles;
+    uint64_t lastCallbackBytes;
+    uint32_t lastCallbackFiles;
+    double startTime;
+    double lastCallbackTime;
+    bool isCancelled;
+    bool isExclusive;       // destination files are created only when they don't exist
+} CopyTracker;
+
+#if defined(__linux__) && !defined(FICLONE)
+    #define FICLONE _IOW(0x94, 9, int)  // from linux/fs.h, which conflicts with glibc mount headers
+#endif
+
+#if defined(__linux__) && !defined(RENAME_NOREPLACE)
+    #define RENAME_NOREPLACE (1 << 0)   // from linux/fs.h, older glibc doesn't have it in stdio.h
+#endif
+
+#if defined(__linux__)
+struct DirIndexEntry {
+    char *path;             // NULL for empty slot
+    uint32_t pathLength;
+    uint32_t hash;
+    uint8_t type;           // FileType
+    bool isSeen;            // found in directory during rescan
+};
+
+struct DirIndexWatch {
+    char *path;             // NULL when descriptor is not used
+    uint32_t pathLength;
+    int64_t modifiedSeconds;   // directory time of the last scan, checked after event queue overflow
+    int64_t modifiedNanos;
+};
+
+#define DIR_INDEX_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ONLYDIR | IN_DONT_FOLLOW)
+#define DIR_INDEX_EVENT_BUFFER_SIZE 4096
+
+static char removedIndexEntry[1];    // marks removed slot, so probing continues after it
+#endif
+
+#if defined(__linux__)
+typedef struct LinuxDirent64 {     // record layout returned by getdents64()
+    uint64_t d_ino;
+    int64_t d_off;
+    uint16_t d_reclen;
+    uint8_t d_type;
+    char d_name[];
+} LinuxDirent64;
+
+#define DIR_BATCH_ALIGN(offset) (((offset) + 7) & ~(uintptr_t) 7)
+#endif
+
+#ifdef FILE_UTILS_ENABLE_THREADS
+// Work stealing deque of directories waiting for the walk. Owner thread pushes and pops from the bottom,
+// idle threads steal from the top, so each thread walks its own subtree depth first while others take its oldest work
+typedef struct WalkWorker {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    uint32_t top;
+    uint32_t bottom;
+    uint32_t id;
+    uint32_t visitedCount;
+    struct ParallelWalk *walk;
+    char dirQueue[PARALLEL_WALK_QUEUE_SIZE][PATH_MAX_LEN];
+} WalkWorker;
+
+typedef struct ParallelWalk {
+    pthread_mutex_t lock;
+    pthread_cond_t hasWork;
+    int32_t queuedDirs;     // may go below zero for a moment when dir is stolen before its push is counted
+    uint32_t activeWorkers;
+    bool isStopped;
+    uint32_t workerCount;
+    WalkWorker *workers;
+    FileVisitor visitor;
+    void *context;
+} ParallelWalk;
+
+typedef struct VecCollector {
+    pthread_mutex_t lock;
+    fileVector *vec;
+} VecCollector;
+
+typedef struct CopyTask {
+    int srcFd;
+    int destFd;
+} CopyTask;
+#endif
+
+// Queue between directory walk and copy workers: walk creates directories and opens files, workers copy data
+typedef struct CopyPool CopyPool;
+
+#ifdef FILE_UTILS_ENABLE_THREADS
+struct CopyPool {
+    pthread_mutex_t lock;
+    pthread_cond_t hasTask;
+    pthread_cond_t hasSpace;
+    uint32_t head;
+    uint32_t count;
+    bool isClosed;      // walk is finished, no more tasks
+    bool isFailed;
+    CopyTask tasks[PARALLEL_COPY_QUEUE_SIZE];
+};
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64) && defined(FILE_UTILS_ENABLE_THREADS)
+// Records are kept in ring until they are synced. Positions are byte counts since writer was opened:
+// 'syncedBytes' <= 'takenBytes' (batch being written) <= 'queuedBytes', ring index is position % capacity
+struct AppendWriterState {
+    int fd;
+    char *buffer;
+    uint32_t capacity;
+    uint64_t queuedBytes;
+    uint64_t takenBytes;
+    uint64_t syncedBytes;
+    uint32_t queuedRecords;     // not yet taken to batch
+    double batchStartTime;      // when first not taken record was appended, 0 - none
+    bool isFlushRequested;
+    bool isClosing;
+    bool isFailed;
+    double openTime;
+    double totalBatchLatency;
+    AppendWriterStats stats;
+    pthread_mutex_t lock;
+    pthread_cond_t hasRecords;  // wakes flusher
+    pthread_cond_t hasSpace;
+    pthread_cond_t isSynced;
+    pthread_t flusher;
+};
+#endif
+
+#if defined(USE_IO_URING)
+// Shared submission and completion rings mapped from io_uring descriptor
+typedef struct IoUring {
+    int fd;
+    void *sqRing;
+    void *cqRing;           // same mapping as 'sqRing' with IORING_FEAT_SINGLE_MMAP
+    size_t sqRingSize;
+    size_t cqRingSize;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+    uint32_t *sqHead;
+    uint32_t *sqTail;
+    uint32_t *sqMask;
+    uint32_t *sqArray;
+    uint32_t sqEntries;
+    uint32_t *cqHead;
+    uint32_t *cqTail;
+    uint32_t *cqMask;
+    struct io_uring_cqe *cqes;
+    uint32_t toSubmit;      // entries added after last io_uring_enter()
+} IoUring;
+
+typedef struct IoUringSlot {
+    FileOp *op;
+    struct statx statx;     // kernel writes here, converted to 'struct stat' of the operation on completion
+} IoUringSlot;
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64)
+struct FileOpBackend {
+    uint32_t depth;
+    FileOp **completed;     // ring of finished operations, not yet returned to caller
+    uint32_t completedHead;
+    uint32_t completedCount;
+#if defined(USE_IO_URING)
+    IoUring ring;
+    IoUringSlot *slots;     // one per operation in flight, index is passed as user data
+    uint32_t *freeSlots;
+    uint32_t freeSlotCount;
+#endif
+#ifdef FILE_UTILS_ENABLE_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t hasPending;
+    pthread_cond_t hasCompleted;
+    FileOp **pending;       // ring of submitted operations waiting for a worker
+    uint32_t pendingHead;
+    uint32_t pendingCount;
+    bool isClosed;
+    uint32_t workerCount;
+    pthread_t workers[FILE_OP_QUEUE_THREADS];
+#endif
+};
+#endif
 
 static File *normalizePath(File *file, const char *path);
-static void listFilesInDir(File *directory, fileVector *vec, bool recursive, bool includeDirs);
+static void listFilesInDir(File *directory, fileVector *vec, bool recursive, bool includeDirs, char *buffer, uint32_t length);
+static bool listFilesInDirToList(File *directory, FileList *list, bool recursive, bool includeDirs);
+static bool openIterator(FileIterator *iterator, File *directory, bool recursive, bool followLinks);
+static void setIteratorBuffer(FileIterator *iterator, char *buffer, uint32_t length);
+static WalkEvent nextWalkEvent(FileIterator *iterator);
+static bool readIteratorEntry(FileIterator *iterator, uint32_t level, const char **name, uint8_t *direntType);
+static bool pushIteratorDir(FileIterator *iterator, DIR *dir);
+#if defined(__linux__)
+static uint32_t reserveChildBatch(FileIterator *iterator, uint32_t parentLevel);
+#endif
+static FileType getFileType(FileIterator *iterator, const char *name, uint8_t direntType);
+static bool removeIteratorEntry(FileIterator *iterator, bool isDir);
+static void sortPaths(PathSort *sort, uint32_t low, uint32_t count, uint32_t depth);
+static uint32_t getCommonPathPrefix(PathSort *sort, uint32_t low, uint32_t count, uint32_t depth);
+static void insertionSortPaths(PathSort *sort, uint32_t low, uint32_t count, uint32_t depth);
+static void swapSortedPaths(PathSort *sort, uint32_t one, uint32_t two);
+static void copyVecItem(File *dest, File *src);
+static bool listCachedDir(CachedWalk *walk, uint32_t depth);
+static int64_t findCachedDir(DirCache *cache, File *directory);
+static bool readCachedDir(DirCacheRecord *record, File *directory);
+static DirCacheRecord *addCachedDir(DirCache *cache, File *directory, uint32_t hash);
+static bool growDirCacheSlots(DirCache *cache);
+static uint32_t hashPath(const char *path, uint32_t length);
+#if defined(__linux__)
+static void scanIndexDir(DirIndex *index, File *directory, bool recursive);
+static void rescanIndexDir(DirIndex *index, uint32_t watchDescriptor);
+static void applyIndexEvent(DirIndex *index, struct inotify_event *event);
+static bool addIndexWatch(DirIndex *index, File *directory);
+static void removeIndexWatches(DirIndex *index, const char *path, uint32_t length);
+static DirIndexEntry *findIndexEntry(DirIndex *index, const char *path, uint32_t length, uint32_t hash);
+static bool addIndexEntry(DirIndex *index, File *file, FileType type);
+static void removeIndexEntries(DirIndex *index, const char *path, uint32_t length);
+static bool growIndexEntries(DirIndex *index);
+static bool isPathUnder(const char *path, uint32_t length, const char *parent, uint32_t parentLength);
+#endif
+static bool isFilterAccepted(FileIterator *iterator, FileFilter *filter);
+static bool isExtensionAccepted(const char *name, FileFilter *filter);
+static bool isCharInSet(const char **pattern, char nameChar);
+#ifdef FILE_UTILS_ENABLE_THREADS
+static void *runWalkWorker(void *arg);
+static bool pushWalkDir(WalkWorker *worker, File *dir);
+static bool takeWalkDir(WalkWorker *worker, File *dir);
+static bool stealWalkDir(WalkWorker *victim, File *dir);
+static void copyQueuedDir(File *dir, const char *queuedPath);
+static void walkDirInParallel(WalkWorker *worker, File *dir);
+static bool collectFileToVec(File *file, FileType type, void *context);
+static int compareFilePaths(const void *one, const void *two);
+#endif
+static CopyStrategy copyFileTracked(File *srcFile, File *destFile, CopyMode mode, CopyTracker *tracker);
+static bool moveFileTracked(File *srcFile, File *destDir, MoveMode mode, CopyProgressOptions *options, CopyStats *stats);
+static bool moveDirTracked(File *srcDir, File *destDir, MoveMode mode, CopyProgressOptions *options, CopyStats *stats);
+static int moveDirEntries(File *srcDir, File *destDir, MoveMode mode);
+static int renamePath(const char *srcPath, const char *destPath, MoveMode mode);
+static bool isCopyNeededAfterRename(int error, MoveMode mode);
+static bool isSameOrSubDir(File *dir, File *parentDir);
+#if !defined(_WIN32) && !defined(_WIN64)
+static CopyStrategy copyFileData(int srcFd, int destFd, CopyMode mode, bool isDestEmpty, CopyTracker *tracker);
+static CopyStrategy copyFileDataByBlocks(int srcFd, int destFd, CopyTracker *tracker);
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+static CopyStrategy copySparseFileData(int srcFd, int destFd, off_t size, CopyTracker *tracker);
+static bool copyFileDataRange(int srcFd, int destFd, off_t offset, off_t length, CopyTracker *tracker);
+#endif
+#endif
+static void startCopyTracker(CopyTracker *tracker, CopyProgressOptions *options);
+static void finishCopyTracker(CopyTracker *tracker, bool isCopied, CopyStats *stats);
+static bool countCopyTotals(File *srcDir, CopyTracker *tracker);
+static bool trackCopiedBytes(CopyTracker *tracker, uint64_t length);
+static bool trackCopiedFile(CopyTracker *tracker);
+static bool trackClonedFile(CopyTracker *tracker, int srcFd);
+static bool notifyCopyProgress(CopyTracker *tracker);
+static void countCopySyscalls(CopyTracker *tracker, uint32_t count);
+static bool isCopyCancelled(CopyTracker *tracker);
+static size_t getCopyChunkSize(CopyTracker *tracker);
+static double getMonotonicSeconds();
+#if !defined(_WIN32) && !defined(_WIN64)
+static bool copyChangedBlocks(int srcFd, int destFd, DeltaCopyStats *stats);
+static int64_t readBlockAt(int fd, char *buffer, uint32_t length, off_t offset);
+static bool writeBlockAt(int fd, const char *buffer, uint32_t length, off_t offset);
+#endif
+static uint32_t weakBlockChecksum(const char *data, uint32_t length);
+static bool copyDirTree(File *srcDir, File *destDir, CopyPool *pool, CopyTracker *tracker);
+#if !defined(_WIN32) && !defined(_WIN64)
+static bool copyDirEntry(FileIterator *iterator, int destDir, CopyPool *pool, CopyTracker *tracker);
+#endif
+#ifdef FILE_UTILS_ENABLE_THREADS
+static void *runCopyWorker(void *arg);
+static bool pushCopyTask(CopyPool *pool, int srcFd, int destFd);
+#endif
+#if !defined(_WIN32) && !defined(_WIN64)
+static FileOp *nextCompletedFileOp(FileOpQueue *queue, bool isWaiting);
+static void executeFileOp(FileOp *op);
+static void pushCompletedFileOp(FileOpBackend *backend, FileOp *op);
+static FileOp *takeCompletedFileOp(FileOpBackend *backend);
+#endif
+#if defined(USE_IO_URING)
+static bool openIoUring(FileOpQueue *queue);
+static void *mapIoUring(int fd, size_t size, off_t offset);
+static void closeIoUring(FileOpBackend *backend);
+static bool pushIoUringOp(FileOpBackend *backend, FileOp *op);
+static bool enterIoUring(IoUring *ring, uint32_t minComplete);
+static FileOp *reapIoUringOp(FileOpBackend *backend);
+static void statxToStat(struct statx *statx, struct stat *result);
+#endif
+#if !defined(_WIN32) && !defined(_WIN64) && defined(FILE_UTILS_ENABLE_THREADS)
+static bool openFileOpWorkers(FileOpQueue *queue);
+static void closeFileOpWorkers(FileOpBackend *backend);
+static void *runFileOpWorker(void *arg);
+#endif
+#if !defined(_WIN32) && !defined(_WIN64) && defined(FILE_UTILS_ENABLE_THREADS)
+static void *runAppendFlusher(void *arg);
+static void waitAppendBatch(AppendWriter *writer);
+static bool writeAppendBatch(AppendWriterState *state, uint64_t start, uint64_t end, bool isSynced);
+#endif
+#if !defined(_WIN32) && !defined(_WIN64)
+static uint64_t writeVectors(int fd, struct iovec *vectors, int count);
+static uint64_t writeFully(int fd, const char *data, uint64_t length);
+static bool syncFileData(int fd);
+static bool fillAtomicTempFile(int fd, const char *data, uint64_t length, struct stat *target, WriteDurability durability);
+static bool linkAtomicTempFile(int fd, const char *path, char *tempPath);
+static bool replaceWithTempFile(const char *tempPath, const char *path, const char *parentPath, WriteDurability durability);
+#endif
+static bool makeAtomicTempPath(const char *path, char *tempPath);
 static uint32_t concatEndSeparator(char *path, uint32_t length);
 static uint32_t removeEndSeparator(char *path, uint32_t length);
-static uint32_t readFileContents(const char *path, char *buffer, uint32_t length);
-static void removeFilesInDir(fileVector *vec);
-static void removeSubDirs(fileVector *vec);
+static uint64_t readFileContents(const char *path, char *buffer, uint64_t length);
 static uint32_t removeSizeName(char *text);
 
 File *newFile(File *file, const char *path) {
@@ -73,11 +467,11 @@ bool createFile(File *file) {
         return false;
     }
 
-    file->file = fopen(file->path, "ab+");
-    if (file->file == NULL) {
+    FILE *stream = fopen(file->path, "ab+");    // 'file->file' is left to opened handle
+    if (stream == NULL) {
         return false;
     }
-    fclose(file->file);
+    fclose(stream);
     return true;
 }
 
@@ -117,9 +511,9 @@ bool createSubDirs(File *directory) {
 
 bool isFileExists(File *file) {
     if (file == NULL) return false;
-    file->file = fopen(file->path, "r");
-    if (file->file == NULL) return false;
-    fclose(file->file);
+    FILE *stream = fopen(file->path, "r");
+    if (stream == NULL) return false;
+    fclose(stream);
     return true;
 }
 
@@ -172,13 +566,16 @@ bool isDirectory(File *directory) {
 }
 
 uint64_t getFileSize(File *file) {
-    if (file == NULL || (file->file = fopen(file->path, "rb")) == NULL) {
+    if (file == NULL || file->pathLength == 0) {
         return 0;
     }
-    fseek(file->file, 0, SEEK_END);
-    uint32_t fileSize = ftell(file->file);
-    fclose(file->file);
-    return fileSize;
+#if defined(_WIN32) || defined(_WIN64)
+    struct _stati64 info;
+    return _stati64(file->path, &info) == 0 && (info.st_mode & S_IFMT) == S_IFREG ? (uint64_t) info.st_size : 0;
+#else
+    struct stat info;
+    return stat(file->path, &info) == 0 && S_ISREG(info.st_mode) ? (uint64_t) info.st_size : 0;
+#endif
 }
 
 BufferString *getFileName(File *file, BufferString *result) {
@@ -200,332 +597,3849 @@ BufferString *getParentName(File *file, BufferString *result) {
 }
 
 void listFiles(File *directory, fileVector *vec, bool recursive) {
-    listFilesInDir(directory, vec, recursive, false);
+    listFilesInDir(directory, vec, recursive, false, NULL, 0);
 }
 
 void listFilesAndDirs(File *directory, fileVector *vec, bool recursive) {
-    listFilesInDir(directory, vec, recursive, true);
+    listFilesInDir(directory, vec, recursive, true, NULL, 0);
 }
 
-void cleanDirectory(File *directory) {
-    fileVector *vec = NEW_VECTOR_BUFF(File, file,  fileBuffer, MAX_FILES_IN_DIR);
-    listFilesInDir(directory, vec, true, true);
-    removeFilesInDir(vec);  // remove all files first
-    removeSubDirs(vec);     // then remove directories
+void listFilesBuffered(File *directory, fileVector *vec, bool recursive, char *buffer, uint32_t length) {
+    listFilesInDir(directory, vec, recursive, false, buffer, length);
+}
 
-    if (isfileVecNotEmpty(vec)) {   // check that all deleted, if not remove next time
-        removeSubDirs(vec);
-    }
+void listFilesAndDirsBuffered(File *directory, fileVector *vec, bool recursive, char *buffer, uint32_t length) {
+    listFilesInDir(directory, vec, recursive, true, buffer, length);
 }
 
-bool deleteDirectory(File *dir) {
-    if (!isDirectory(dir) || !isDirExists(dir)) {
-        return false;
+FileList *newFileList(FileList *list, void *buffer, uint32_t bufferSize, uint32_t maxEntries) {
+    if (list == NULL || buffer == NULL) {
+        return NULL;
     }
-    cleanDirectory(dir);
-    return rmdir(dir->path) == 0;
+
+    uint32_t alignment = (sizeof(uint32_t) - (uintptr_t) buffer % sizeof(uint32_t)) % sizeof(uint32_t);
+    uint64_t entriesSize = (uint64_t) maxEntries * FILE_LIST_ENTRY_SIZE;
+    if (bufferSize < alignment + entriesSize) {
+        return NULL;
+    }
+
+    char *entries = (char *) buffer + alignment;
+    list->pathOffsets = (uint32_t *) entries;
+    list->pathLengths = (uint16_t *) (entries + maxEntries * sizeof(uint32_t));
+    list->types = (uint8_t *) (entries + maxEntries * (sizeof(uint32_t) + sizeof(uint16_t)));
+    list->pathArena = entries + entriesSize;
+    list->capacity = maxEntries;
+    list->arenaCapacity = bufferSize - alignment - entriesSize;
+    clearFileList(list);
+    return list;
 }
 
-bool copyFile(File *srcFile, File *destFile) {
-    if (!isFileExists(srcFile)) {
+bool listFilesToList(File *directory, FileList *list, bool recursive) {
+    return listFilesInDirToList(directory, list, recursive, false);
+}
+
+bool listFilesAndDirsToList(File *directory, FileList *list, bool recursive) {
+    return listFilesInDirToList(directory, list, recursive, true);
+}
+
+bool addToFileList(FileList *list, const char *path, uint32_t length, FileType type) {
+    if (list->size >= list->capacity || list->arenaLength + length + 1 > list->arenaCapacity || length >= PATH_MAX_LEN) {
         return false;
     }
 
-    if (destFile == NULL || strcmp(srcFile->path, destFile->path) == 0) {
-        return false;
+    memcpy(list->pathArena + list->arenaLength, path, length + 1);
+    list->pathOffsets[list->size] = list->arenaLength;
+    list->pathLengths[list->size] = length;
+    list->types[list->size] = type;
+    list->arenaLength += length + 1;
+    list->size++;
+    return true;
+}
+
+void listFilesFiltered(File *directory, fileVector *vec, FileFilter *filter) {
+    FileIterator iterator;
+    if (vec == NULL || filter == NULL || !openIterator(&iterator, directory, true, true)) {
+        return;
     }
 
-    if (!isFileExists(destFile)) {
-        if (!createFileDirs(destFile) || !createFile(destFile)) {
-            return false;
+    File *file;
+    while ((file = nextFilteredFile(&iterator, filter)) != NULL) {
+        if (vec->size >= vec->capacity) {
+            break;
         }
-    }
 
-    srcFile->file = fopen(srcFile->path, "r");
-    if (srcFile->file == NULL) {
-        return false;
+        File *item = &vec->items[vec->size];
+        memcpy(item->path, file->path, file->pathLength + 1);
+        item->pathLength = file->pathLength;
+        vec->size++;
     }
+    closeFileIterator(&iterator);
+}
 
-    destFile->file = fopen(destFile->path, "w");
-    if (destFile->file == NULL) {
-        fclose(srcFile->file);
+bool listFilesFilteredToList(File *directory, FileList *list, FileFilter *filter) {
+    FileIterator iterator;
+    if (list == NULL || filter == NULL || !openIterator(&iterator, directory, true, true)) {
         return false;
     }
 
-    int dataChar;
-    while ((dataChar = fgetc(srcFile->file)) != EOF) {
-        fputc(dataChar, destFile->file);
+    bool isAllListed = true;
+    File *file;
+    while ((file = nextFilteredFile(&iterator, filter)) != NULL) {
+        if (!addToFileList(list, file->path, file->pathLength, iterator.entryType)) {
+            isAllListed = false;
+            break;
+        }
     }
-
-    fclose(srcFile->file);
-    fclose(destFile->file);
-    return true;
+    closeFileIterator(&iterator);
+    return isAllListed && !iterator.isFailed;
 }
 
-bool copyDirectory(File *srcDir, File *destDir) {
-    if (strcmp(srcDir->path, destDir->path) == 0) {
-        return false;       // cannot copy directory to a subdirectory of itself
-    }
-
-    if (!isDirExists(srcDir) || !isDirExists(destDir)) {
+bool isFileNameMatches(const char *name, const char *pattern) {
+    if (name == NULL || pattern == NULL) {
         return false;
     }
 
-    fileVector *vec = NEW_VECTOR_BUFF(File, file, fileBuffer, MAX_FILES_IN_DIR);
-    listFilesInDir(srcDir, vec, true, true);
-    for (uint32_t i = 0; i < fileVecSize(vec); i++) {
-        File srcFile = fileVecGet(vec, i);
-        BufferString *subPath = SUBSTRING_CSTR_AFTER(PATH_MAX_LEN, srcFile.path, srcDir->path);
-        File *copiedFile = FILE_OF(destDir, subPath->value);
-
-        if (isDirectory(&srcFile)) {
-            if (MKDIR(copiedFile->path) == -1 && errno != EEXIST) {
-                return false;
-            }
+    const char *starPattern = NULL;     // position after last '*' to backtrack when rest doesn't match
+    const char *starName = NULL;
+    while (*name != '\0') {
+        if (*pattern == '*') {
+            starPattern = ++pattern;
+            starName = name;
             continue;
         }
 
-        if (!createFile(copiedFile)) {
+        const char *nextPattern = pattern;
+        bool isCharMatches = false;
+        if (*pattern == '?') {
+            isCharMatches = true;
+            nextPattern++;
+        } else if (*pattern == '[') {
+            isCharMatches = isCharInSet(&nextPattern, *name);
+        } else if (*pattern != '\0') {
+            isCharMatches = *pattern == *name;
+            nextPattern++;
+        }
+
+        if (isCharMatches) {
+            pattern = nextPattern;
+            name++;
+        } else if (starPattern != NULL) {   // let last '*' take one more char
+            pattern = starPattern;
+            name = ++starName;
+        } else {
             return false;
         }
     }
 
-    return true;
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == '\0';
 }
 
-bool moveFileToDir(File *srcFile, File *destDir) {
-    if (!isFileExists(srcFile)) {
-        return false;
+void initDirCache(DirCache *cache) {
+    if (cache != NULL) {
+        memset(cache, 0, sizeof(DirCache));
     }
+}
 
-    if (!isDirExists(destDir)) {
-        createSubDirs(destDir);
-        if (MKDIR(destDir->path) != 0) {
-            return false;
-        }
+void listFilesCached(DirCache *cache, File *directory, fileVector *vec, bool recursive) {
+    if (cache != NULL && directory != NULL && vec != NULL) {
+        CachedWalk walk = {.cache = cache, .vec = vec, .recursive = recursive, .includeDirs = false, .dir = *directory};
+        listCachedDir(&walk, 1);
     }
+}
 
-    BufferString *fileName = EMPTY_STRING(PATH_MAX_LEN);
-    getFileName(srcFile, fileName);
-    File destFile = {0};
-    newFileFromParent(&destFile, destDir, fileName->value);
-    return copyFile(srcFile, &destFile) && remove(srcFile->path) == 0;
+void listFilesAndDirsCached(DirCache *cache, File *directory, fileVector *vec, bool recursive) {
+    if (cache != NULL && directory != NULL && vec != NULL) {
+        CachedWalk walk = {.cache = cache, .vec = vec, .recursive = recursive, .includeDirs = true, .dir = *directory};
+        listCachedDir(&walk, 1);
+    }
 }
 
-bool moveDirToDir(File *srcDir, File *destDir) {
-    if (!isDirExists(destDir)) {
-        createSubDirs(destDir);
-        if (MKDIR(destDir->path) != 0) {
-            return false;
-        }
+void freeDirCache(DirCache *cache) {
+    if (cache == NULL) {
+        return;
     }
 
-    return copyDirectory(srcDir, destDir) && deleteDirectory(srcDir);
+    for (uint32_t i = 0; i < cache->recordCount; i++) {
+        free(cache->records[i].data);
+    }
+    free(cache->records);
+    free(cache->slots);
+    initDirCache(cache);
 }
 
-uint32_t readFileToBuffer(File *file, char *buffer, uint32_t length) {
-    return file != NULL && file->pathLength > 0 ? readFileContents(file->path, buffer, length) : 0;
-}
+#if defined(__linux__)
+bool openDirIndex(DirIndex *index, File *directory) {
+    if (index == NULL || directory == NULL) {
+        return false;
+    }
 
-uint32_t readFileToString(File *file, BufferString *str) {
-    str->length += readFileToBuffer(file, str->value, str->capacity - str->length);
-    return str->length;
-}
+    memset(index, 0, sizeof(DirIndex));
+    index->root = *directory;
+    index->notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (index->notifyFd == -1) {
+        return false;
+    }
 
-uint32_t writeCharsToFile(File *file, const char *data, uint32_t length, bool append) {
-    if (!isFileExists(file)) return 0;
+    if (!addIndexWatch(index, &index->root)) {  // watch is added before read, so no change is lost between them
+        closeDirIndex(index);
+        return false;
+    }
+    scanIndexDir(index, &index->root, true);
+    return true;
+}
 
-    file->file = fopen(file->path, append ? "a" : "wb");
-    if (file->file == NULL) {
+// Applies all pending events without blocking, returns number of events read
+uint32_t updateDirIndex(DirIndex *index) {
+    if (index == NULL || index->notifyFd == -1) {
         return 0;
     }
 
-    length = fwrite(data, sizeof(char), length, file->file);
-    fclose(file->file);
-    return length;
+    char buffer[DIR_INDEX_EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    uint32_t eventCount = 0;
+    ssize_t length;
+    while ((length = read(index->notifyFd, buffer, sizeof(buffer))) > 0) {
+        for (char *position = buffer; position < buffer + length;) {
+            struct inotify_event *event = (struct inotify_event *) position;
+            applyIndexEvent(index, event);
+            position += sizeof(struct inotify_event) + event->len;
+            eventCount++;
+        }
+    }
+    return eventCount;
 }
 
-uint32_t writeStringToFile(File *file, BufferString *str, bool append) {
-    return writeCharsToFile(file, str->value, str->length, append);
+bool isInDirIndex(DirIndex *index, File *file) {
+    if (index == NULL || file == NULL || index->slotCount == 0) {
+        return false;
+    }
+    return findIndexEntry(index, file->path, file->pathLength, hashPath(file->path, file->pathLength)) != NULL;
 }
 
-BufferString *byteCountToDisplaySize(uint64_t bytes, BufferString *result) {
-    if (bytes == 0 || result == NULL) return result;
-
-    char *sizeUnits;
-    if ((bytes / ONE_TB) > 0) {
-        sizeUnits = " TB";
-        bytes /= ONE_TB;
-
-    } else if ((bytes / ONE_GB) > 0) {
-        sizeUnits = " GB";
-        bytes /= ONE_GB;
-
-    } else if ((bytes / ONE_MB) > 0) {
-        sizeUnits = " MB";
-        bytes /= ONE_MB;
+void dirIndexToVec(DirIndex *index, fileVector *vec, bool includeDirs) {
+    if (index == NULL || vec == NULL) {
+        return;
+    }
 
-    }  else if ((bytes / ONE_KB) > 0) {
-        sizeUnits = " KB";
-        bytes /= ONE_KB;
+    for (uint32_t i = 0; i < index->slotCount && vec->size < vec->capacity; i++) {
+        DirIndexEntry *entry = &index->entries[i];
+        if (entry->path == NULL || entry->path == removedIndexEntry || (!includeDirs && entry->type != FILE_TYPE_REGULAR)) {
+            continue;
+        }
 
-    } else {
-        sizeUnits = " bytes";
+        File *file = &vec->items[vec->size++];
+        memcpy(file->path, entry->path, entry->pathLength + 1);
+        file->pathLength = entry->pathLength;
     }
-
-    uInt64ToString(result, bytes);
-    return concatChars(result, sizeUnits);
 }
 
-uint64_t displaySizeToBytes(const char *sizeStr) {
-    if (sizeStr == NULL) return 0;
-
-    BufferString *inputSize = NEW_STRING_32(sizeStr);
-    trimAll(inputSize);
-    toUpperCase(inputSize);
-
-    if (containsStr(inputSize, "TB")) {
-        removeSizeName(inputSize->value);
-        return strtol(inputSize->value, NULL, 10) * ONE_TB;
-
-    } else if (containsStr(inputSize, "GB")) {
-        removeSizeName(inputSize->value);
-        return strtol(inputSize->value, NULL, 10) * ONE_GB;
+void closeDirIndex(DirIndex *index) {
+    if (index == NULL) {
+        return;
+    }
 
-    } else if (containsStr(inputSize, "MB")) {
-        removeSizeName(inputSize->value);
-        return strtol(inputSize->value, NULL, 10) * ONE_MB;
+    if (index->notifyFd != -1) {
+        close(index->notifyFd);     // releases all watches
+        index->notifyFd = -1;
+    }
+    for (uint32_t i = 0; i < index->slotCount; i++) {
+        if (index->entries[i].path != removedIndexEntry) free(index->entries[i].path);
+    }
+    for (uint32_t i = 0; i < index->watchCapacity; i++) {
+        free(index->watches[i].path);
+    }
+    free(index->entries);
+    free(index->watches);
+    index->entries = NULL;
+    index->watches = NULL;
+    index->entryCount = 0;
+    index->usedSlots = 0;
+    index->slotCount = 0;
+    index->watchCapacity = 0;
+}
+#endif
 
-    } else if (containsStr(inputSize, "KB")) {
-        removeSizeName(inputSize->value);
-        return strtol(inputSize->value, NULL, 10) * ONE_KB;
+const char *fileListPath(FileList *list, uint32_t index) {
+    return list != NULL && index < list->size ? list->pathArena + list->pathOffsets[index] : NULL;
+}
 
-    } else {
-        return strtol(inputSize->value, NULL, 10);
+File *fileListGet(FileList *list, uint32_t index, File *file) {
+    const char *path = fileListPath(list, index);
+    if (path == NULL || file == NULL) {
+        return NULL;
     }
-}
 
-uint32_t fileChecksumCRC32(File *file, char *buffer, uint32_t length) {
-    if (!isFileExists(file)) return 0;
-    uint32_t dataLength = readFileContents(file->path, buffer, length);
-    return generateCRC32(buffer, dataLength);
+    memcpy(file->path, path, list->pathLengths[index] + 1);
+    file->pathLength = list->pathLengths[index];
+    file->file = NULL;
+    file->dir = NULL;
+    return file;
 }
 
-uint16_t fileChecksumCRC16(File *file, char *buffer, uint32_t length) {
-    if (!isFileExists(file)) return 0;
-    uint32_t dataLength = readFileContents(file->path, buffer, length);
-    return generateCRC16(buffer, dataLength);
+void clearFileList(FileList *list) {
+    list->size = 0;
+    list->arenaLength = 0;
 }
 
-static File *normalizePath(File *file, const char *path) {
-    BufferString *pathStr = NEW_STRING(PATH_MAX_LEN, path);
-    replaceFirstOccurrence(pathStr, PATH_SEPARATOR_TO_REPLACE, PATH_SEPARATOR_STR);
-    replaceAllOccurrences(pathStr, FILE_NAME_SEPARATOR_TO_REPLACE, FILE_NAME_SEPARATOR_STR);
-    replaceAllOccurrences(pathStr, MULTIPLE_PATH_SEPARATORS, FILE_NAME_SEPARATOR_STR);
-    pathStr->length = removeEndSeparator(pathStr->value, pathStr->length);
-    strcpy(file->path, pathStr->value);
-    file->pathLength = pathStr->length;
-    return file;
+void sortFileList(FileList *list) {
+    if (list != NULL && list->size > 1) {
+        PathSort sort = {.list = list};
+        sortPaths(&sort, 0, list->size, 0);
+    }
 }
 
-static void listFilesInDir(File *directory, fileVector *vec, bool recursive, bool includeDirs) {
-    if (!isDirectory(directory) || !isDirExists(directory)) {
+void sortFileVector(fileVector *vec, uint32_t *order) {
+    if (vec == NULL || order == NULL || vec->size < 2) {
         return;
     }
 
-    directory->dir = opendir(directory->path);
-    if (directory->dir == NULL) {
-        return;
+    for (uint32_t i = 0; i < vec->size; i++) {
+        order[i] = i;
     }
+    PathSort sort = {.vec = vec, .order = order};
+    sortPaths(&sort, 0, vec->size, 0);
 
-    struct dirent *inDirectory;
-    while ((inDirectory = readdir(directory->dir)) != NULL) {
-        if (strncmp(inDirectory->d_name, ".", 1) == 0 || strncmp(inDirectory->d_name, "..", 2) == 0) {  // On linux/Unix and windows we don't want current and parent directories
-            continue;
+    File tmpItem;   // move items by cycles of permutation, each item is copied once
+    for (uint32_t i = 0; i < vec->size; i++) {
+        if (order[i] == i) continue;
+
+        copyVecItem(&tmpItem, &vec->items[i]);
+        uint32_t position = i;
+        while (order[position] != i) {
+            uint32_t next = order[position];
+            copyVecItem(&vec->items[position], &vec->items[next]);
+            order[position] = position;
+            position = next;
         }
+        copyVecItem(&vec->items[position], &tmpItem);
+        order[position] = position;
+    }
+}
 
-        File tmpFile = {0};
-        strncpy(tmpFile.path, directory->path, directory->pathLength);
-        tmpFile.pathLength = directory->pathLength;
-        tmpFile.pathLength = concatEndSeparator(tmpFile.path, tmpFile.pathLength);
+bool openFileIterator(FileIterator *iterator, File *directory, bool recursive) {
+    return iterator != NULL && openIterator(iterator, directory, recursive, true);
+}
 
-        uint32_t dirNameLength = strlen(inDirectory->d_name);
-        strcat(tmpFile.path, inDirectory->d_name);
-        tmpFile.pathLength += dirNameLength;
-        if (includeDirs || isFile(&tmpFile)) {
-            if (vec->size >= vec->capacity) {
-                closedir(directory->dir);
-                return;
-            }
+bool openFileIteratorBuffered(FileIterator *iterator, File *directory, bool recursive, char *buffer, uint32_t length) {
+    if (!openFileIterator(iterator, directory, recursive)) {
+        return false;
+    }
+    setIteratorBuffer(iterator, buffer, length);
+    return true;
+}
 
-            File *file = &vec->items[vec->size];
-            strncpy(file->path, tmpFile.path, tmpFile.pathLength);
-            file->pathLength = tmpFile.pathLength;
-            file->path[file->pathLength] = '\0';
-            vec->size++;
+File *nextFile(FileIterator *iterator) {
+    WalkEvent event;
+    while ((event = nextWalkEvent(iterator)) != WALK_END) {
+        if (event == WALK_ENTRY && iterator->entryType == FILE_TYPE_REGULAR) {
+            return &iterator->entry;
         }
+    }
+    return NULL;
+}
 
-        if (recursive && isDirectory(&tmpFile)) {
-            listFilesInDir(&tmpFile, vec, recursive, includeDirs);
+File *nextFileOrDir(FileIterator *iterator) {
+    WalkEvent event;
+    while ((event = nextWalkEvent(iterator)) != WALK_END) {
+        if (event == WALK_ENTRY) {
+            return &iterator->entry;
         }
     }
-    closedir(directory->dir);
+    return NULL;
 }
 
-static uint32_t concatEndSeparator(char *path, uint32_t length) {
-    if (path[length - 1] != FILE_NAME_SEPARATOR_CHAR) {
-        strcat(path, FILE_NAME_SEPARATOR_STR);
-        length++;
+File *nextFilteredFile(FileIterator *iterator, FileFilter *filter) {
+    WalkEvent event;
+    while ((event = nextWalkEvent(iterator)) != WALK_END) {
+        if (event == WALK_ENTRY && (filter == NULL || isFilterAccepted(iterator, filter))) {
+            return &iterator->entry;
+        }
+    }
+    return NULL;
+}
+
+void closeFileIterator(FileIterator *iterator) {
+    iterator->isDescendPending = false;
+    while (iterator->depth > 0) {
+        closedir(iterator->dirs[--iterator->depth]);
+    }
+}
+
+#ifdef FILE_UTILS_ENABLE_THREADS
+uint32_t listFilesParallel(File *directory, uint32_t threads, FileVisitor visitor, void *context) {
+    if (directory == NULL || visitor == NULL || !isDirExists(directory)) {
+        return 0;
+    }
+
+    threads = threads < 1 ? 1 : threads > MAX_WALK_THREADS ? MAX_WALK_THREADS : threads;
+    ParallelWalk walk = {.workerCount = threads, .visitor = visitor, .context = context};
+    walk.workers = calloc(threads, sizeof(WalkWorker));
+    if (walk.workers == NULL) {
+        return 0;
+    }
+
+    pthread_mutex_init(&walk.lock, NULL);
+    pthread_cond_init(&walk.hasWork, NULL);
+    for (uint32_t i = 0; i < threads; i++) {
+        walk.workers[i].id = i;
+        walk.workers[i].walk = &walk;
+        pthread_mutex_init(&walk.workers[i].lock, NULL);
+    }
+    pushWalkDir(&walk.workers[0], directory);
+
+    uint32_t startedThreads = 1;    // calling thread runs as worker 0
+    for (; startedThreads < threads; startedThreads++) {
+        WalkWorker *worker = &walk.workers[startedThreads];
+        if (pthread_create(&worker->thread, NULL, runWalkWorker, worker) != 0) {
+            break;
+        }
+    }
+    runWalkWorker(&walk.workers[0]);
+
+    uint32_t visitedCount = walk.workers[0].visitedCount;
+    for (uint32_t i = 1; i < startedThreads; i++) {
+        pthread_join(walk.workers[i].thread, NULL);
+        visitedCount += walk.workers[i].visitedCount;
+    }
+
+    for (uint32_t i = 0; i < threads; i++) {
+        pthread_mutex_destroy(&walk.workers[i].lock);
+    }
+    pthread_cond_destroy(&walk.hasWork);
+    pthread_mutex_destroy(&walk.lock);
+    free(walk.workers);
+    return visitedCount;
+}
+
+void listFilesParallelToVec(File *directory, fileVector *vec, uint32_t threads, bool sorted) {
+    if (vec == NULL) return;
+    VecCollector collector = {.vec = vec};
+    pthread_mutex_init(&collector.lock, NULL);
+    listFilesParallel(directory, threads, collectFileToVec, &collector);
+    pthread_mutex_destroy(&collector.lock);
+
+    if (!sorted) {
+        return;
+    }
+
+    uint32_t *order = malloc(vec->size * sizeof(uint32_t));
+    if (order != NULL) {
+        sortFileVector(vec, order);
+        free(order);
+    } else {
+        qsort(vec->items, vec->size, sizeof(File), compareFilePaths);
+    }
+}
+#endif
+
+void cleanDirectory(File *directory) {
+    FileIterator iterator;
+    if (!openIterator(&iterator, directory, true, false)) {
+        return;
+    }
+
+    WalkEvent event;
+    while ((event = nextWalkEvent(&iterator)) != WALK_END) {
+        if (event == WALK_ENTRY && iterator.entryType != FILE_TYPE_DIRECTORY) {
+            removeIteratorEntry(&iterator, false);
+
+        } else if (event == WALK_DIR_EXIT) {    // directory is empty now
+            removeIteratorEntry(&iterator, true);
+        }
+    }
+    closeFileIterator(&iterator);
+}
+
+bool deleteDirectory(File *dir) {
+    if (!isDirectory(dir) || !isDirExists(dir)) {
+        return false;
+    }
+    cleanDirectory(dir);
+    return rmdir(dir->path) == 0;
+}
+
+bool copyFile(File *srcFile, File *destFile) {
+    return copyFileWithMode(srcFile, destFile, COPY_MODE_CLONE_OR_COPY) != COPY_STRATEGY_NONE;
+}
+
+CopyStrategy copyFileWithMode(File *srcFile, File *destFile, CopyMode mode) {
+    return copyFileTracked(srcFile, destFile, mode, NULL);
+}
+
+bool copyFileWithProgress(File *srcFile, File *destFile, CopyProgressOptions *options, CopyStats *stats) {
+    CopyTracker tracker;
+    startCopyTracker(&tracker, options);
+    tracker.progress.filesTotal = 1;
+    tracker.progress.bytesTotal = isFileExists(srcFile) ? getFileSize(srcFile) : 0;
+    bool isCopied = copyFileTracked(srcFile, destFile, COPY_MODE_CLONE_OR_COPY, &tracker) != COPY_STRATEGY_NONE;
+    if (isCopied && !trackCopiedFile(&tracker)) {
+        tracker.isCancelled = false;    // file is already copied, nothing left to cancel
+    }
+    finishCopyTracker(&tracker, isCopied, stats);
+    return isCopied;
+}
+
+bool copyFileDelta(File *srcFile, File *destFile, uint32_t blockSize, DeltaCopyStats *stats) {
+    DeltaCopyStats delta = {.blockSize = blockSize > 0 ? blockSize : DELTA_COPY_BLOCK_SIZE};
+    if (stats != NULL) {
+        *stats = delta;
+    }
+    if (!isFileExists(srcFile) || destFile == NULL || strcmp(srcFile->path, destFile->path) == 0) {
+        return false;
+    }
+
+    bool isCopied = false;
+#if defined(_WIN32) || defined(_WIN64)
+    bool isFullCopy = true;
+#else
+    bool isFullCopy = !isFileExists(destFile);
+#endif
+    if (isFullCopy) {   // nothing to compare with
+        isCopied = copyFile(srcFile, destFile);
+        delta.bytesTransferred = isCopied ? getFileSize(destFile) : 0;
+        delta.blocksTransferred = (uint32_t) ((delta.bytesTransferred + delta.blockSize - 1) / delta.blockSize);
+    } else {
+#if !defined(_WIN32) && !defined(_WIN64)
+        int srcFd = open(srcFile->path, O_RDONLY | O_CLOEXEC);
+        int destFd = srcFd != -1 ? open(destFile->path, O_RDWR | O_CLOEXEC) : -1;
+        isCopied = srcFd != -1 && destFd != -1 && copyChangedBlocks(srcFd, destFd, &delta);
+        if (srcFd != -1) {
+            close(srcFd);
+        }
+        if (destFd != -1) {
+            isCopied = close(destFd) == 0 && isCopied;
+        }
+#endif
+    }
+
+    if (stats != NULL) {
+        *stats = delta;
+    }
+    return isCopied;
+}
+
+bool copyDirectory(File *srcDir, File *destDir) {
+    return copyDirTree(srcDir, destDir, NULL, NULL);
+}
+
+bool copyDirectoryWithProgress(File *srcDir, File *destDir, CopyProgressOptions *options, CopyStats *stats) {
+    CopyTracker tracker;
+    startCopyTracker(&tracker, options);
+    bool isCopied = countCopyTotals(srcDir, &tracker) && copyDirTree(srcDir, destDir, NULL, &tracker);
+    finishCopyTracker(&tracker, isCopied, stats);
+    return isCopied;
+}
+
+#ifdef FILE_UTILS_ENABLE_THREADS
+bool copyDirectoryParallel(File *srcDir, File *destDir, uint32_t threads) {
+    threads = threads < 1 ? 1 : threads > MAX_COPY_THREADS ? MAX_COPY_THREADS : threads;
+    if (threads == 1) {
+        return copyDirTree(srcDir, destDir, NULL, NULL);
+    }
+
+    CopyPool *pool = calloc(1, sizeof(CopyPool));
+    if (pool == NULL) {
+        return false;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->hasTask, NULL);
+    pthread_cond_init(&pool->hasSpace, NULL);
+
+    pthread_t workers[MAX_COPY_THREADS];
+    uint32_t startedThreads = 0;
+    for (; startedThreads < threads; startedThreads++) {
+        if (pthread_create(&workers[startedThreads], NULL, runCopyWorker, pool) != 0) {
+            break;
+        }
+    }
+
+    bool isCopied = copyDirTree(srcDir, destDir, startedThreads > 0 ? pool : NULL, NULL);    // calling thread walks the tree
+    pthread_mutex_lock(&pool->lock);
+    pool->isClosed = true;
+    pthread_cond_broadcast(&pool->hasTask);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint32_t i = 0; i < startedThreads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    isCopied = isCopied && !pool->isFailed;
+
+    pthread_cond_destroy(&pool->hasSpace);
+    pthread_cond_destroy(&pool->hasTask);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+    return isCopied;
+}
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64)
+bool openFileOpQueue(FileOpQueue *queue, uint32_t depth, FileOpEngine engine) {
+    if (queue == NULL || depth == 0) {
+        return false;
+    }
+
+    *queue = (FileOpQueue) {.engine = FILE_OP_ENGINE_SYNC, .depth = depth};
+    FileOpBackend *backend = calloc(1, sizeof(FileOpBackend));
+    if (backend == NULL) {
+        return false;
+    }
+    backend->depth = depth;
+    backend->completed = malloc(depth * sizeof(FileOp *));
+    if (backend->completed == NULL) {
+        free(backend);
+        return false;
+    }
+    queue->backend = backend;
+
+    bool isOpened = false;
+#if defined(USE_IO_URING)
+    if (engine == FILE_OP_ENGINE_AUTO || engine == FILE_OP_ENGINE_IO_URING) {
+        isOpened = openIoUring(queue);
+    }
+#endif
+#ifdef FILE_UTILS_ENABLE_THREADS
+    if (!isOpened && (engine == FILE_OP_ENGINE_AUTO || engine == FILE_OP_ENGINE_THREADS)) {
+        isOpened = openFileOpWorkers(queue);
+    }
+#endif
+    if (!isOpened && (engine == FILE_OP_ENGINE_AUTO || engine == FILE_OP_ENGINE_SYNC)) {
+        queue->engine = FILE_OP_ENGINE_SYNC;
+        isOpened = true;
+    }
+
+    if (!isOpened) {
+        free(backend->completed);
+        free(backend);
+        queue->backend = NULL;
+    }
+    return isOpened;
+}
+
+bool submitFileOp(FileOpQueue *queue, FileOp *op) {
+    if (queue->backend == NULL || op == NULL || op->type > FILE_OP_STATX || queue->inFlight == queue->depth) {
+        return false;
+    }
+
+    FileOpBackend *backend = queue->backend;
+    switch (queue->engine) {
+#if defined(USE_IO_URING)
+        case FILE_OP_ENGINE_IO_URING:
+            if (!pushIoUringOp(backend, op)) {
+                return false;
+            }
+            break;
+#endif
+#ifdef FILE_UTILS_ENABLE_THREADS
+        case FILE_OP_ENGINE_THREADS:
+            pthread_mutex_lock(&backend->lock);
+            backend->pending[(backend->pendingHead + backend->pendingCount) % backend->depth] = op;
+            backend->pendingCount++;
+            pthread_cond_signal(&backend->hasPending);
+            pthread_mutex_unlock(&backend->lock);
+            break;
+#endif
+        default:
+            executeFileOp(op);
+            pushCompletedFileOp(backend, op);
+    }
+    queue->inFlight++;
+    return true;
+}
+
+bool flushFileOps(FileOpQueue *queue) {
+    if (queue->backend == NULL) {
+        return false;
+    }
+#if defined(USE_IO_URING)
+    if (queue->engine == FILE_OP_ENGINE_IO_URING && queue->backend->ring.toSubmit > 0) {
+        return enterIoUring(&queue->backend->ring, 0);
+    }
+#endif
+    return true;
+}
+
+FileOp *waitFileOp(FileOpQueue *queue) {
+    return nextCompletedFileOp(queue, true);
+}
+
+FileOp *pollFileOp(FileOpQueue *queue) {
+    return nextCompletedFileOp(queue, false);
+}
+
+void closeFileOpQueue(FileOpQueue *queue) {
+    if (queue->backend == NULL) {
+        return;
+    }
+
+    while (waitFileOp(queue) != NULL);  // kernel or workers may still write to caller buffers
+#if defined(USE_IO_URING)
+    if (queue->engine == FILE_OP_ENGINE_IO_URING) {
+        closeIoUring(queue->backend);
+    }
+#endif
+#ifdef FILE_UTILS_ENABLE_THREADS
+    if (queue->engine == FILE_OP_ENGINE_THREADS) {
+        closeFileOpWorkers(queue->backend);
+    }
+#endif
+    free(queue->backend->completed);
+    free(queue->backend);
+    queue->backend = NULL;
+    queue->inFlight = 0;
+}
+#endif
+
+bool moveFileToDir(File *srcFile, File *destDir) {
+    return moveFileTracked(srcFile, destDir, MOVE_MODE_REPLACE, NULL, NULL);
+}
+
+bool moveFileToDirWithMode(File *srcFile, File *destDir, MoveMode mode) {
+    return moveFileTracked(srcFile, destDir, mode, NULL, NULL);
+}
+
+bool moveFileToDirWithProgress(File *srcFile, File *destDir, CopyProgressOptions *options, CopyStats *stats) {
+    return moveFileTracked(srcFile, destDir, MOVE_MODE_REPLACE, options, stats);
+}
+
+bool moveDirToDir(File *srcDir, File *destDir) {
+    return moveDirTracked(srcDir, destDir, MOVE_MODE_REPLACE, NULL, NULL);
+}
+
+bool moveDirToDirWithMode(File *srcDir, File *destDir, MoveMode mode) {
+    return moveDirTracked(srcDir, destDir, mode, NULL, NULL);
+}
+
+bool moveDirToDirWithProgress(File *srcDir, File *destDir, CopyProgressOptions *options, CopyStats *stats) {
+    return moveDirTracked(srcDir, destDir, MOVE_MODE_REPLACE, options, stats);
+}
+
+uint64_t readFileToBuffer(File *file, char *buffer, uint64_t length) {
+    return file != NULL && file->pathLength > 0 ? readFileContents(file->path, buffer, length) : 0;
+}
+
+uint32_t readFileToString(File *file, BufferString *str) {
+    if (str->length + 1 >= str->capacity) return str->length;
+    str->length += readFileToBuffer(file, str->value + str->length, str->capacity - str->length - 1);    // keep space for terminator
+    return str->length;
+}
+
+bool openFileView(File *file, FileView *view, FileViewHint hint, bool isPopulated) {
+    *view = (FileView) {0};
+    if (file == NULL || file->pathLength == 0) {
+        return false;
+    }
+
+#if defined(_WIN32) || defined(_WIN64)
+    struct stat info;
+    if (stat(file->path, &info) != 0 || (info.st_mode & S_IFMT) != S_IFREG) {
+        return false;
+    }
+    view->length = (uint64_t) info.st_size;
+    if (view->length == 0) {
+        view->data = "";
+        return true;
+    }
+
+    char *data = malloc(view->length);
+    FILE *stream = fopen(file->path, "rb");
+    bool isRead = data != NULL && stream != NULL && fread(data, 1, view->length, stream) == view->length;
+    if (stream != NULL) {
+        fclose(stream);
+    }
+    if (!isRead) {
+        free(data);
+        *view = (FileView) {0};
+        return false;
+    }
+    view->data = data;
+    return true;
+#else
+    int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || (uint64_t) info.st_size > SIZE_MAX) {
+        close(fd);
+        return false;
+    }
+    view->length = (uint64_t) info.st_size;
+    if (view->length == 0) {    // empty mapping is not allowed
+        close(fd);
+        view->data = "";
+        return true;
+    }
+
+    int flags = MAP_SHARED;
+#if defined(MAP_POPULATE)
+    flags |= isPopulated ? MAP_POPULATE : 0;    // fault in all pages now instead of one by one on first access
+#endif
+    void *data = mmap(NULL, view->length, PROT_READ, flags, fd, 0);
+    close(fd);      // mapping keeps file open
+    if (data == MAP_FAILED) {
+        *view = (FileView) {0};
+        return false;
+    }
+
+#if !defined(MAP_POPULATE)
+    hint = isPopulated ? FILE_VIEW_HINT_WILL_NEED : hint;
+#endif
+    if (hint == FILE_VIEW_HINT_SEQUENTIAL) {
+        madvise(data, view->length, MADV_SEQUENTIAL);
+    } else if (hint == FILE_VIEW_HINT_RANDOM) {
+        madvise(data, view->length, MADV_RANDOM);
+    } else if (hint == FILE_VIEW_HINT_WILL_NEED) {
+        madvise(data, view->length, MADV_WILLNEED);
+    }
+    view->data = data;
+    view->isMapped = true;
+    return true;
+#endif
+}
+
+// Points string to view data without copying. String is not null terminated and must not be changed, capacity is
+// equal to length so appending to it fails. Returns NULL when 'offset' is out of view
+BufferString *getFileViewString(FileView *view, uint64_t offset, uint32_t length, BufferString *str) {
+    if (view->data == NULL || offset > view->length) {
+        return NULL;
+    }
+
+    uint64_t available = view->length - offset;
+    str->value = (char *) view->data + offset;
+    str->length = available < length ? (uint32_t) available : length;
+    str->capacity = str->length;
+    return str;
+}
+
+void closeFileView(FileView *view) {
+    if (view->data != NULL && view->length > 0) {
+#if defined(_WIN32) || defined(_WIN64)
+        free((char *) view->data);
+#else
+        munmap((void *) view->data, view->length);
+#endif
+    }
+    *view = (FileView) {0};
+}
+
+bool openFileReader(File *file, FileReader *reader, char *buffer, uint32_t capacity) {
+    *reader = (FileReader) {.buffer = buffer, .capacity = capacity};
+#if !defined(_WIN32) && !defined(_WIN64)
+    reader->fd = -1;
+#endif
+    if (file == NULL || file->pathLength == 0 || buffer == NULL || capacity == 0) {
+        return false;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    reader->stream = fopen(file->path, "rb");
+    return reader->stream != NULL;
+#else
+    reader->fd = open(file->path, O_RDONLY | O_CLOEXEC);
+    if (reader->fd == -1) {
+        return false;
+    }
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);   // larger readahead, chunks are read one after another
+#endif
+    return true;
+#endif
+}
+
+// Returns length of next chunk placed at the buffer start, 0 at end of file or on error
+uint32_t readNextChunk(FileReader *reader) {
+    reader->offset += reader->length;
+    reader->length = 0;
+#if defined(_WIN32) || defined(_WIN64)
+    if (reader->stream == NULL) {
+        return 0;
+    }
+    reader->length = fread(reader->buffer, 1, reader->capacity, reader->stream);
+    reader->isFailed = ferror(reader->stream) != 0;
+#else
+    if (reader->fd == -1) {
+        return 0;
+    }
+    while (reader->length < reader->capacity) {     // short read doesn't mean end of file for pipes and network filesystems
+        ssize_t count = read(reader->fd, reader->buffer + reader->length, reader->capacity - reader->length);
+        if (count == -1 && errno == EINTR) continue;
+        if (count <= 0) {
+            reader->isFailed = count == -1;
+            break;
+        }
+        reader->length += count;
+    }
+#endif
+    return reader->length;
+}
+
+void closeFileReader(FileReader *reader) {
+#if defined(_WIN32) || defined(_WIN64)
+    if (reader->stream != NULL) {
+        fclose(reader->stream);
+        reader->stream = NULL;
+    }
+#else
+    if (reader->fd != -1) {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+#endif
+}
+
+// Passes whole file to callback chunk by chunk. Returns 'true' when end of file is reached without errors and
+// callback hasn't stopped the read
+bool readFileByChunks(File *file, char *buffer, uint32_t length, FileChunkCallback callback, void *context) {
+    FileReader reader;
+    if (callback == NULL || !openFileReader(file, &reader, buffer, length)) {
+        return false;
+    }
+
+    bool isCompleted = true;
+    while (isCompleted && readNextChunk(&reader) > 0) {
+        isCompleted = callback(reader.buffer, reader.length, reader.offset, context);
+    }
+    closeFileReader(&reader);
+    return isCompleted && !reader.isFailed;
+}
+
+// File must exist. For many writes to the same file use openFileHandle(), it keeps file open between them
+uint64_t writeCharsToFile(File *file, const char *data, uint64_t length, bool append) {
+    if (file == NULL || file->pathLength == 0) return 0;
+#if defined(_WIN32) || defined(_WIN64)
+    if (!isFileExists(file)) return 0;
+
+    FILE *stream = fopen(file->path, append ? "a" : "wb");
+    if (stream == NULL) {
+        return 0;
+    }
+
+    length = fwrite(data, sizeof(char), (size_t) length, stream);
+    fclose(stream);
+    return length;
+#else
+    int fd = open(file->path, O_WRONLY | (append ? O_APPEND : O_TRUNC) | O_CLOEXEC);  // no O_CREAT, fails for missing file
+    if (fd == -1) {
+        return 0;
+    }
+
+    uint64_t written = writeFully(fd, data, length);
+    close(fd);
+    return written;
+#endif
+}
+
+// New contents go to temp file in the same directory, then it's renamed over target, so readers never see partial file.
+// Target is created when missing, existing target permissions are kept
+bool writeCharsToFileAtomic(File *file, const char *data, uint64_t length, WriteDurability durability) {
+    if (file == NULL || file->pathLength == 0 || (data == NULL && length > 0)) return false;
+    char tempPath[PATH_MAX_LEN];
+#if defined(_WIN32) || defined(_WIN64)
+    if (!makeAtomicTempPath(file->path, tempPath)) return false;
+    FILE *stream = fopen(tempPath, "wb");   // name is unique for process and call
+    if (stream == NULL) {
+        return false;
+    }
+
+    bool isWritten = fwrite(data, sizeof(char), (size_t) length, stream) == length && fflush(stream) == 0;
+    if (isWritten && durability != WRITE_DURABILITY_NONE) {
+        isWritten = _commit(_fileno(stream)) == 0;
+    }
+    isWritten = fclose(stream) == 0 && isWritten;
+
+    DWORD flags = MOVEFILE_REPLACE_EXISTING | (durability == WRITE_DURABILITY_FULL ? MOVEFILE_WRITE_THROUGH : 0);
+    if (!isWritten || !MoveFileExA(tempPath, file->path, flags)) {
+        remove(tempPath);
+        return false;
+    }
+    return true;
+#else
+    char parentPath[PATH_MAX_LEN];
+    File *parent = getParentFile(&(File){0}, file);
+    if (parent->pathLength > 0) {
+        strcpy(parentPath, parent->path);
+    } else {
+        strcpy(parentPath, file->path[0] == FILE_NAME_SEPARATOR_CHAR ? FILE_NAME_SEPARATOR_STR : ".");
+    }
+
+    struct stat targetInfo;
+    struct stat *target = stat(file->path, &targetInfo) == 0 ? &targetInfo : NULL;
+#if defined(__linux__) && defined(O_TMPFILE)
+    // Unnamed file is linked into directory only when complete, so failed write or crash leaves nothing behind.
+    // Named temp file is used when filesystem doesn't support O_TMPFILE or /proc is not mounted to link it
+    int fd = open(parentPath, O_TMPFILE | O_WRONLY | O_CLOEXEC, 0666);
+    if (fd != -1) {
+        if (!fillAtomicTempFile(fd, data, length, target, durability)) {
+            close(fd);
+            return false;   // write or sync error, named file would fail the same way
+        }
+
+        bool isLinked = linkAtomicTempFile(fd, file->path, tempPath);
+        int linkError = errno;
+        if (close(fd) != 0) {
+            if (isLinked) unlink(tempPath);
+            return false;
+        }
+        if (isLinked) {
+            return replaceWithTempFile(tempPath, file->path, parentPath, durability);
+        }
+        if (linkError != ENOENT && linkError != EOPNOTSUPP && linkError != EPERM) {
+            return false;
+        }
+    }
+#endif
+    int tempFd = -1;
+    for (uint32_t i = 0; i < ATOMIC_WRITE_NAME_ATTEMPTS && tempFd == -1; i++) {
+        if (!makeAtomicTempPath(file->path, tempPath)) return false;
+        tempFd = open(tempPath, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (tempFd == -1 && errno != EEXIST) return false;
+    }
+    if (tempFd == -1) return false;
+
+    bool isWritten = fillAtomicTempFile(tempFd, data, length, target, durability);
+    if (close(tempFd) != 0 || !isWritten) {
+        unlink(tempPath);
+        return false;
+    }
+    return replaceWithTempFile(tempPath, file->path, parentPath, durability);
+#endif
+}
+
+bool writeStringToFileAtomic(File *file, BufferString *str, WriteDurability durability) {
+    return str != NULL && writeCharsToFileAtomic(file, str->value, str->length, durability);
+}
+
+// Fails when handle is already opened, close it first
+bool openFileHandle(File *file, FileHandleMode mode) {
+    if (file == NULL || file->pathLength == 0 || file->file != NULL || (uint32_t) mode > FILE_HANDLE_READ_WRITE) {
+        return false;
+    }
+
+    static const char *streamModes[] = {"rb", "wb", "ab", "r+b"};
+    file->file = fopen(file->path, streamModes[mode]);
+    return file->file != NULL;
+}
+
+uint64_t writeFileHandle(File *file, const char *data, uint64_t length) {
+    if (file == NULL || file->file == NULL) {
+        return 0;
+    }
+    return fwrite(data, sizeof(char), (size_t) length, file->file);
+}
+
+uint64_t readFileHandle(File *file, char *buffer, uint64_t length) {
+    if (file == NULL || file->file == NULL) {
+        return 0;
+    }
+    return fread(buffer, sizeof(char), (size_t) length, file->file);
+}
+
+// Passes buffered data to the system, it's not synced to disk
+bool flushFileHandle(File *file) {
+    return file != NULL && file->file != NULL && fflush(file->file) == 0;
+}
+
+bool closeFileHandle(File *file) {
+    if (file == NULL || file->file == NULL) {
+        return false;
+    }
+    bool isClosed = fclose(file->file) == 0;    // fails when buffered data can't be written
+    file->file = NULL;
+    return isClosed;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64) && defined(FILE_UTILS_ENABLE_THREADS)
+bool openAppendWriter(AppendWriter *writer, File *file, AppendWriterOptions *options) {
+    writer->options = options != NULL ? *options : (AppendWriterOptions) {0};
+    writer->options.bufferSize = writer->options.bufferSize > 0 ? writer->options.bufferSize : APPEND_WRITER_BUFFER_SIZE;
+    writer->options.flushBytes = writer->options.flushBytes > 0 ? writer->options.flushBytes : APPEND_WRITER_FLUSH_BYTES;
+    writer->options.flushDelayUs = writer->options.flushDelayUs > 0 ? writer->options.flushDelayUs : APPEND_WRITER_FLUSH_DELAY_US;
+    writer->state = NULL;
+    if (file == NULL || file->pathLength == 0) {
+        return false;
+    }
+
+    AppendWriterState *state = calloc(1, sizeof(AppendWriterState));
+    if (state == NULL) {
+        return false;
+    }
+    state->capacity = writer->options.bufferSize;
+    state->buffer = malloc(state->capacity);
+    state->fd = open(file->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (state->buffer == NULL || state->fd == -1) {
+        if (state->fd != -1) close(state->fd);
+        free(state->buffer);
+        free(state);
+        return false;
+    }
+
+    pthread_mutex_init(&state->lock, NULL);
+    pthread_cond_init(&state->hasRecords, NULL);
+    pthread_cond_init(&state->hasSpace, NULL);
+    pthread_cond_init(&state->isSynced, NULL);
+    state->openTime = getMonotonicSeconds();
+    writer->state = state;
+    if (pthread_create(&state->flusher, NULL, runAppendFlusher, writer) != 0) {
+        pthread_cond_destroy(&state->isSynced);
+        pthread_cond_destroy(&state->hasSpace);
+        pthread_cond_destroy(&state->hasRecords);
+        pthread_mutex_destroy(&state->lock);
+        close(state->fd);
+        free(state->buffer);
+        free(state);
+        writer->state = NULL;
+        return false;
+    }
+    return true;
+}
+
+// Copies record to memory and returns without waiting for disk. 'position' (optional) receives position after
+// the record for waitAppendDurable(). Blocks while buffer has no space, fails when record is larger than buffer
+bool appendRecord(AppendWriter *writer, const char *data, uint32_t length, uint64_t *position) {
+    AppendWriterState *state = writer->state;
+    if (state == NULL || length > state->capacity) {
+        return false;
+    }
+
+    pthread_mutex_lock(&state->lock);
+    while (!state->isFailed && !state->isClosing && state->capacity - (state->queuedBytes - state->syncedBytes) < length) {
+        state->isFlushRequested = true;     // don't wait for deadline, space is needed now
+        pthread_cond_signal(&state->hasRecords);
+        pthread_cond_wait(&state->hasSpace, &state->lock);
+    }
+    if (state->isFailed || state->isClosing) {
+        pthread_mutex_unlock(&state->lock);
+        return false;
+    }
+    if (length == 0) {
+        if (position != NULL) *position = state->queuedBytes;
+        pthread_mutex_unlock(&state->lock);
+        return true;
+    }
+
+    uint32_t start = state->queuedBytes % state->capacity;
+    uint32_t firstPart = state->capacity - start < length ? state->capacity - start : length;
+    memcpy(state->buffer + start, data, firstPart);
+    memcpy(state->buffer, data + firstPart, length - firstPart);    // wrapped around ring end
+    state->queuedBytes += length;
+    state->queuedRecords++;
+
+    uint64_t pendingBytes = state->queuedBytes - state->takenBytes;
+    if (state->batchStartTime == 0) {
+        state->batchStartTime = getMonotonicSeconds();
+        pthread_cond_signal(&state->hasRecords);    // starts flush deadline
+    } else if (pendingBytes >= writer->options.flushBytes && pendingBytes - length < writer->options.flushBytes) {
+        pthread_cond_signal(&state->hasRecords);
+    }
+    if (position != NULL) {
+        *position = state->queuedBytes;
+    }
+    pthread_mutex_unlock(&state->lock);
+    return true;
+}
+
+// Waits until all records up to 'position' are on disk, 'false' when write has failed. Waiting record doesn't wait
+// for flush delay, it goes with the next batch. Records appended while batch is written are grouped into the next one
+bool waitAppendDurable(AppendWriter *writer, uint64_t position) {
+    AppendWriterState *state = writer->state;
+    if (state == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&state->lock);
+    if (state->takenBytes < position && !state->isFlushRequested) {
+        state->isFlushRequested = true;
+        pthread_cond_signal(&state->hasRecords);
+    }
+    while (state->syncedBytes < position && !state->isFailed) {
+        pthread_cond_wait(&state->isSynced, &state->lock);
+    }
+    bool isSynced = state->syncedBytes >= position;
+    pthread_mutex_unlock(&state->lock);
+    return isSynced;
+}
+
+// Writes all appended records now, without waiting for batch size or deadline
+bool flushAppendWriter(AppendWriter *writer) {
+    AppendWriterState *state = writer->state;
+    if (state == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&state->lock);
+    uint64_t position = state->queuedBytes;
+    state->isFlushRequested = true;
+    pthread_cond_signal(&state->hasRecords);
+    pthread_mutex_unlock(&state->lock);
+    return waitAppendDurable(writer, position);
+}
+
+void getAppendWriterStats(AppendWriter *writer, AppendWriterStats *stats) {
+    AppendWriterState *state = writer->state;
+    *stats = (AppendWriterStats) {0};
+    if (state == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&state->lock);
+    *stats = state->stats;
+    stats->seconds = getMonotonicSeconds() - state->openTime;
+    stats->recordsPerSecond = stats->seconds > 0 ? (double) stats->records / stats->seconds : 0;
+    stats->avgBatchLatency = stats->batches > 0 ? state->totalBatchLatency / stats->batches : 0;
+    pthread_mutex_unlock(&state->lock);
+}
+
+// Writes remaining records and stops flusher. Returns 'false' when any batch has failed
+bool closeAppendWriter(AppendWriter *writer, AppendWriterStats *stats) {
+    AppendWriterState *state = writer->state;
+    if (state == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&state->lock);
+    state->isClosing = true;
+    pthread_cond_broadcast(&state->hasRecords);
+    pthread_cond_broadcast(&state->hasSpace);
+    pthread_mutex_unlock(&state->lock);
+    pthread_join(state->flusher, NULL);
+
+    if (stats != NULL) {
+        getAppendWriterStats(writer, stats);
+    }
+    bool isWritten = !state->isFailed;
+    isWritten = close(state->fd) == 0 && isWritten;
+    pthread_cond_destroy(&state->isSynced);
+    pthread_cond_destroy(&state->hasSpace);
+    pthread_cond_destroy(&state->hasRecords);
+    pthread_mutex_destroy(&state->lock);
+    free(state->buffer);
+    free(state);
+    writer->state = NULL;
+    return isWritten;
+}
+#endif
+
+uint32_t writeStringToFile(File *file, BufferString *str, bool append) {
+    return writeCharsToFile(file, str->value, str->length, append);
+}
+
+// Writes all parts one after another with single open, in one writev() call for up to IOV_MAX parts. File must exist
+uint64_t writeStringsToFile(File *file, BufferString **parts, uint32_t count, bool append) {
+    if (file == NULL || file->pathLength == 0 || (parts == NULL && count > 0)) return 0;
+#if defined(_WIN32) || defined(_WIN64)
+    if (!isFileExists(file)) return 0;
+
+    FILE *stream = fopen(file->path, append ? "a" : "wb");
+    if (stream == NULL) {
+        return 0;
+    }
+
+    uint64_t written = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t length = fwrite(parts[i]->value, sizeof(char), parts[i]->length, stream);
+        written += length;
+        if (length != parts[i]->length) break;
+    }
+    fclose(stream);
+    return written;
+#else
+    int fd = open(file->path, O_WRONLY | (append ? O_APPEND : O_TRUNC) | O_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+
+    struct iovec vectors[WRITE_VECTORS_MAX];
+    uint64_t written = 0;
+    for (uint32_t first = 0; first < count;) {
+        uint32_t vectorCount = 0;
+        uint64_t length = 0;
+        for (; first < count && vectorCount < WRITE_VECTORS_MAX; first++) {
+            if (parts[first] == NULL || parts[first]->length == 0) continue;
+            vectors[vectorCount++] = (struct iovec) {.iov_base = parts[first]->value, .iov_len = parts[first]->length};
+            length += parts[first]->length;
+        }
+
+        uint64_t vectorsWritten = writeVectors(fd, vectors, (int) vectorCount);
+        written += vectorsWritten;
+        if (vectorsWritten != length) break;
+    }
+    close(fd);
+    return written;
+#endif
+}
+
+BufferString *byteCountToDisplaySize(uint64_t bytes, BufferString *result) {
+    if (bytes == 0 || result == NULL) return result;
+
+    char *sizeUnits;
+    if ((bytes / ONE_TB) > 0) {
+        sizeUnits = " TB";
+        bytes /= ONE_TB;
+
+    } else if ((bytes / ONE_GB) > 0) {
+        sizeUnits = " GB";
+        bytes /= ONE_GB;
+
+    } else if ((bytes / ONE_MB) > 0) {
+        sizeUnits = " MB";
+        bytes /= ONE_MB;
+
+    }  else if ((bytes / ONE_KB) > 0) {
+        sizeUnits = " KB";
+        bytes /= ONE_KB;
+
+    } else {
+        sizeUnits = " bytes";
+    }
+
+    uInt64ToString(result, bytes);
+    return concatChars(result, sizeUnits);
+}
+
+uint64_t displaySizeToBytes(const char *sizeStr) {
+    if (sizeStr == NULL) return 0;
+
+    BufferString *inputSize = NEW_STRING_32(sizeStr);
+    trimAll(inputSize);
+    toUpperCase(inputSize);
+
+    if (containsStr(inputSize, "TB")) {
+        removeSizeName(inputSize->value);
+        return strtol(inputSize->value, NULL, 10) * ONE_TB;
+
+    } else if (containsStr(inputSize, "GB")) {
+        removeSizeName(inputSize->value);
+        return strtol(inputSize->value, NULL, 10) * ONE_GB;
+
+    } else if (containsStr(inputSize, "MB")) {
+        removeSizeName(inputSize->value);
+        return strtol(inputSize->value, NULL, 10) * ONE_MB;
+
+    } else if (containsStr(inputSize, "KB")) {
+        removeSizeName(inputSize->value);
+        return strtol(inputSize->value, NULL, 10) * ONE_KB;
+
+    } else {
+        return strtol(inputSize->value, NULL, 10);
+    }
+}
+
+uint32_t fileChecksumCRC32(File *file, char *buffer, uint32_t length) {
+    if (!isFileExists(file)) return 0;
+    uint32_t dataLength = readFileContents(file->path, buffer, length);
+    return generateCRC32(buffer, dataLength);
+}
+
+uint16_t fileChecksumCRC16(File *file, char *buffer, uint32_t length) {
+    if (!isFileExists(file)) return 0;
+    uint32_t dataLength = readFileContents(file->path, buffer, length);
+    return generateCRC16(buffer, dataLength);
+}
+
+static File *normalizePath(File *file, const char *path) {
+    BufferString *pathStr = NEW_STRING(PATH_MAX_LEN, path);
+    replaceFirstOccurrence(pathStr, PATH_SEPARATOR_TO_REPLACE, PATH_SEPARATOR_STR);
+    replaceAllOccurrences(pathStr, FILE_NAME_SEPARATOR_TO_REPLACE, FILE_NAME_SEPARATOR_STR);
+    replaceAllOccurrences(pathStr, MULTIPLE_PATH_SEPARATORS, FILE_NAME_SEPARATOR_STR);
+    pathStr->length = removeEndSeparator(pathStr->value, pathStr->length);
+    strcpy(file->path, pathStr->value);
+    file->pathLength = pathStr->length;
+    return file;
+}
+
+static void listFilesInDir(File *directory, fileVector *vec, bool recursive, bool includeDirs, char *buffer, uint32_t length) {
+    FileIterator iterator;
+    if (!openIterator(&iterator, directory, recursive, true)) {
+        return;
+    }
+    setIteratorBuffer(&iterator, buffer, length);
+
+    WalkEvent event;
+    while ((event = nextWalkEvent(&iterator)) != WALK_END) {
+        if (event != WALK_ENTRY || (!includeDirs && iterator.entryType != FILE_TYPE_REGULAR)) {
+            continue;
+        }
+
+        if (vec->size >= vec->capacity) {
+            break;
+        }
+
+        File *file = &vec->items[vec->size];
+        memcpy(file->path, iterator.entry.path, iterator.entry.pathLength + 1);
+        file->pathLength = iterator.entry.pathLength;
+        vec->size++;
+    }
+    closeFileIterator(&iterator);
+}
+
+static bool listFilesInDirToList(File *directory, FileList *list, bool recursive, bool includeDirs) {
+    FileIterator iterator;
+    if (list == NULL || !openIterator(&iterator, directory, recursive, true)) {
+        return false;
+    }
+
+    bool isAllListed = true;
+    WalkEvent event;
+    while ((event = nextWalkEvent(&iterator)) != WALK_END) {
+        if (event != WALK_ENTRY || (!includeDirs && iterator.entryType != FILE_TYPE_REGULAR)) {
+            continue;
+        }
+
+        if (!addToFileList(list, iterator.entry.path, iterator.entry.pathLength, iterator.entryType)) {
+            isAllListed = false;    // no space left
+            break;
+        }
+    }
+    closeFileIterator(&iterator);
+    return isAllListed && !iterator.isFailed;
+}
+
+static bool openIterator(FileIterator *iterator, File *directory, bool recursive, bool followLinks) {
+    if (directory == NULL || directory->pathLength >= PATH_MAX_LEN) {
+        return false;
+    }
+
+    memcpy(iterator->entry.path, directory->path, directory->pathLength + 1);
+    iterator->entry.pathLength = directory->pathLength;
+    iterator->entry.file = NULL;
+    iterator->entry.dir = NULL;
+    iterator->entryName = NULL;
+    iterator->depth = 0;
+    iterator->isDescendPending = false;
+    iterator->isFailed = false;
+    iterator->recursive = recursive;
+    iterator->followLinks = followLinks;
+#if defined(__linux__)
+    iterator->readBuffer = NULL;
+    iterator->readBufferSize = 0;
+#endif
+    return pushIteratorDir(iterator, opendir(directory->path));     // fails with ENOTDIR for regular files, no need for separate stat()
+}
+
+static void setIteratorBuffer(FileIterator *iterator, char *buffer, uint32_t length) {
+#if defined(__linux__)
+    uint32_t alignment = (uintptr_t) -(uintptr_t) buffer & 7;     // getdents64() records are 8 byte aligned
+    if (buffer == NULL || length < alignment + MIN_DIR_READ_BUFFER_SIZE) {
+        return;     // too small for batching, keep readdir()
+    }
+
+    iterator->readBuffer = buffer + alignment;
+    iterator->readBufferSize = length - alignment;
+    iterator->batchStart[0] = 0;    // nothing has been read yet from root directory
+    iterator->batchPosition[0] = 0;
+    iterator->batchEnd[0] = 0;
+    iterator->batchOffset[0] = 0;
+#endif
+}
+
+static WalkEvent nextWalkEvent(FileIterator *iterator) {
+    if (iterator->isDescendPending) {
+        iterator->isDescendPending = false;
+        DIR *childDir = NULL;
+        if (iterator->depth < MAX_DIR_DEPTH) {
+#if defined(_WIN32) || defined(_WIN64)
+            childDir = opendir(iterator->entry.path);
+#else
+            int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | (iterator->followLinks ? 0 : O_NOFOLLOW);
+            int childFd = openat(dirfd(iterator->dirs[iterator->depth - 1]), iterator->entryName, flags);
+            childDir = childFd != -1 ? fdopendir(childFd) : NULL;
+            if (childFd != -1 && childDir == NULL) close(childFd);
+#endif
+        }
+
+        if (!pushIteratorDir(iterator, childDir)) {
+            iterator->isFailed = true;
+            return WALK_DIR_EXIT;   // directory can't be opened or too deep, its contents is skipped
+        }
+    }
+
+    while (iterator->depth > 0) {
+        uint32_t level = iterator->depth - 1;
+        uint32_t dirPathLength = iterator->dirPathLengths[level];
+        const char *name;
+        uint8_t direntType;
+
+        if (!readIteratorEntry(iterator, level, &name, &direntType)) {
+            closedir(iterator->dirs[level]);
+            iterator->depth--;
+            if (iterator->depth == 0) {
+                return WALK_END;
+            }
+
+            uint32_t namePosition = iterator->dirPathLengths[level - 1];
+            namePosition += iterator->entry.path[namePosition] == FILE_NAME_SEPARATOR_CHAR ? 1 : 0;
+            iterator->entry.path[dirPathLength] = '\0';     // restore path of the directory that has been left
+            iterator->entry.pathLength = dirPathLength;
+            iterator->entryName = iterator->entry.path + namePosition;
+            iterator->entryType = FILE_TYPE_DIRECTORY;
+            return WALK_DIR_EXIT;
+        }
+
+        if (strncmp(name, ".", 1) == 0 || strncmp(name, "..", 2) == 0) {  // On linux/Unix and windows we don't want current and parent directories
+            continue;
+        }
+
+        uint32_t nameLength = strlen(name);
+        uint32_t namePosition = dirPathLength;
+        if (namePosition == 0 || iterator->entry.path[namePosition - 1] != FILE_NAME_SEPARATOR_CHAR) {
+            iterator->entry.path[namePosition++] = FILE_NAME_SEPARATOR_CHAR;
+        }
+        if (namePosition + nameLength >= PATH_MAX_LEN) {
+            iterator->isFailed = true;  // entry is skipped, path doesn't fit into File
+            continue;
+        }
+
+        memcpy(iterator->entry.path + namePosition, name, nameLength + 1);
+        iterator->entry.pathLength = namePosition + nameLength;
+        iterator->entryName = iterator->entry.path + namePosition;
+        iterator->entryType = getFileType(iterator, iterator->entryName, direntType);
+        iterator->isDescendPending = iterator->recursive && iterator->entryType == FILE_TYPE_DIRECTORY;
+        return WALK_ENTRY;
+    }
+    return WALK_END;
+}
+
+static bool readIteratorEntry(FileIterator *iterator, uint32_t level, const char **name, uint8_t *direntType) {
+#if defined(__linux__)
+    if (iterator->readBuffer != NULL) {
+        if (iterator->batchPosition[level] >= iterator->batchEnd[level]) {
+            uint32_t start = iterator->batchStart[level];
+            long length = syscall(SYS_getdents64, dirfd(iterator->dirs[level]), iterator->readBuffer + start, iterator->readBufferSize - start);
+            if (length <= 0) {
+                iterator->isFailed = iterator->isFailed || length == -1;
+                return false;
+            }
+            iterator->batchPosition[level] = start;
+            iterator->batchEnd[level] = start + length;
+        }
+
+        LinuxDirent64 *entry = (LinuxDirent64 *) (iterator->readBuffer + iterator->batchPosition[level]);
+        iterator->batchPosition[level] += entry->d_reclen;
+        iterator->batchOffset[level] = entry->d_off;
+        *name = entry->d_name;
+        *direntType = entry->d_type;
+        return true;
+    }
+#endif
+
+    errno = 0;
+    struct dirent *entry = readdir(iterator->dirs[level]);
+    if (entry == NULL) {
+        iterator->isFailed = iterator->isFailed || errno != 0;     // NULL with unchanged errno is the end of directory
+        return false;
+    }
+    *name = entry->d_name;
+#ifdef USE_DIRENT_TYPE
+    *direntType = entry->d_type;
+#else
+    *direntType = 0;
+#endif
+    return true;
+}
+
+static bool pushIteratorDir(FileIterator *iterator, DIR *dir) {
+    if (dir == NULL) {
+        return false;
+    }
+
+#if defined(__linux__)
+    if (iterator->readBuffer != NULL) {
+        uint32_t level = iterator->depth;
+        uint32_t start = level > 0 ? reserveChildBatch(iterator, level - 1) : 0;
+        iterator->batchStart[level] = start;
+        iterator->batchPosition[level] = start;
+        iterator->batchEnd[level] = start;
+        iterator->batchOffset[level] = 0;
+    }
+#endif
+
+    iterator->dirs[iterator->depth] = dir;
+    iterator->dirPathLengths[iterator->depth] = iterator->entry.pathLength;
+    iterator->depth++;
+    return true;
+}
+
+#if defined(__linux__)
+// Read buffer is used as a stack: parent keeps only not yet visited entries and child directory takes the space after them
+static uint32_t reserveChildBatch(FileIterator *iterator, uint32_t parentLevel) {
+    char *buffer = iterator->readBuffer;
+    uint32_t start = iterator->batchStart[parentLevel];
+    uint32_t pendingLength = iterator->batchEnd[parentLevel] - iterator->batchPosition[parentLevel];
+    memmove(buffer + start, buffer + iterator->batchPosition[parentLevel], pendingLength);
+    iterator->batchPosition[parentLevel] = start;
+    iterator->batchEnd[parentLevel] = start + pendingLength;
+
+    uint32_t childStart = (uint32_t) DIR_BATCH_ALIGN(iterator->batchEnd[parentLevel]);
+    if (iterator->readBufferSize - childStart >= MIN_DIR_READ_BUFFER_SIZE) {
+        return childStart;
+    }
+
+    for (uint32_t level = 0; level <= parentLevel; level++) {   // no space left, drop all batches and read them again later
+        lseek(dirfd(iterator->dirs[level]), iterator->batchOffset[level], SEEK_SET);
+        iterator->batchStart[level] = 0;
+        iterator->batchPosition[level] = 0;
+        iterator->batchEnd[level] = 0;
+    }
+    return 0;
+}
+#endif
+
+static FileType getFileType(FileIterator *iterator, const char *name, uint8_t direntType) {
+    struct stat entryInfo;
+#ifdef USE_DIRENT_TYPE
+    switch (direntType) {
+        case DT_REG:
+            return FILE_TYPE_REGULAR;
+        case DT_DIR:
+            return FILE_TYPE_DIRECTORY;
+        case DT_UNKNOWN:    // filesystem doesn't fill 'd_type', e.g. some network and old XFS volumes
+            break;
+        case DT_LNK:        // symlinks are followed same as stat() does
+            if (iterator->followLinks) break;
+            return FILE_TYPE_OTHER;
+        default:
+            return FILE_TYPE_OTHER;
+    }
+#else
+    (void) direntType;
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+    if (stat(iterator->entry.path, &entryInfo) == NO_FILE_INFO) {
+        return FILE_TYPE_OTHER;
+    }
+#else
+    int flags = iterator->followLinks ? 0 : AT_SYMLINK_NOFOLLOW;
+    if (fstatat(dirfd(iterator->dirs[iterator->depth - 1]), name, &entryInfo, flags) == NO_FILE_INFO) {
+        return FILE_TYPE_OTHER;
+    }
+#endif
+
+    if (S_ISREG(entryInfo.st_mode)) return FILE_TYPE_REGULAR;
+    if (S_ISDIR(entryInfo.st_mode)) return FILE_TYPE_DIRECTORY;
+    return FILE_TYPE_OTHER;
+}
+
+// Lists one directory from snapshot and descends to subdirectories in the same order as listFilesInDir(), returns 'false' when vector is full
+static bool listCachedDir(CachedWalk *walk, uint32_t depth) {
+    int64_t recordIndex = findCachedDir(walk->cache, &walk->dir);
+    if (recordIndex < 0) {
+        return true;    // not a directory or no memory for snapshot
+    }
+
+    uint32_t dirPathLength = walk->dir.pathLength;
+    uint32_t namePosition = dirPathLength;
+    if (namePosition == 0 || walk->dir.path[namePosition - 1] != FILE_NAME_SEPARATOR_CHAR) {
+        walk->dir.path[namePosition++] = FILE_NAME_SEPARATOR_CHAR;
+    }
+
+    uint32_t childCount = walk->cache->records[recordIndex].childCount;
+    uint32_t offset = walk->cache->records[recordIndex].pathLength + 1;
+    bool isVecFull = false;
+    for (uint32_t i = 0; i < childCount && !isVecFull; i++) {
+        const char *entry = walk->cache->records[recordIndex].data + offset;    // records may be moved by nested listing
+        FileType type = (FileType) entry[0];
+        uint32_t nameLength = strlen(entry + 1);
+        offset += nameLength + 2;
+        if (namePosition + nameLength >= PATH_MAX_LEN) {
+            continue;
+        }
+
+        memcpy(walk->dir.path + namePosition, entry + 1, nameLength + 1);
+        walk->dir.pathLength = namePosition + nameLength;
+        if (type == FILE_TYPE_REGULAR || walk->includeDirs) {
+            if (walk->vec->size >= walk->vec->capacity) {
+                isVecFull = true;
+                break;
+            }
+            File *file = &walk->vec->items[walk->vec->size++];
+            memcpy(file->path, walk->dir.path, walk->dir.pathLength + 1);
+            file->pathLength = walk->dir.pathLength;
+        }
+
+        if (walk->recursive && type == FILE_TYPE_DIRECTORY && depth < MAX_DIR_DEPTH) {
+            isVecFull = !listCachedDir(walk, depth + 1);
+        }
+    }
+
+    walk->dir.path[dirPathLength] = '\0';
+    walk->dir.pathLength = dirPathLength;
+    return !isVecFull;
+}
+
+// Returns index of up to date snapshot record, directory is read again when it has changed since last listing
+static int64_t findCachedDir(DirCache *cache, File *directory) {
+    struct stat dirInfo;
+    if (stat(directory->path, &dirInfo) == NO_FILE_INFO || !S_ISDIR(dirInfo.st_mode)) {
+        return -1;
+    }
+#if defined(__APPLE__)
+    int64_t modifiedNanos = dirInfo.st_mtimespec.tv_nsec;
+#elif defined(_WIN32) || defined(_WIN64)
+    int64_t modifiedNanos = 0;
+#else
+    int64_t modifiedNanos = dirInfo.st_mtim.tv_nsec;
+#endif
+
+    uint32_t hash = hashPath(directory->path, directory->pathLength);
+    DirCacheRecord *record = NULL;
+    if (cache->slotCount > 0) {
+        uint32_t mask = cache->slotCount - 1;
+        for (uint32_t slot = hash & mask; cache->slots[slot] != 0; slot = (slot + 1) & mask) {
+            DirCacheRecord *candidate = &cache->records[cache->slots[slot] - 1];
+            if (candidate->hash == hash && candidate->pathLength == directory->pathLength &&
+                memcmp(candidate->data, directory->path, directory->pathLength) == 0) {
+                record = candidate;
+                break;
+            }
+        }
+    }
+
+    // Modification time is trusted only when it is older than the read: directory changed within
+    // the same clock tick as it was read would have the same time as in snapshot
+    if (record != NULL && record->device == (uint64_t) dirInfo.st_dev && record->inode == (uint64_t) dirInfo.st_ino &&
+        record->modifiedSeconds == (int64_t) dirInfo.st_mtime && record->modifiedNanos == modifiedNanos &&
+        record->modifiedSeconds < record->readTime) {
+        cache->hits++;
+        return record - cache->records;
+    }
+
+    if (record == NULL && (record = addCachedDir(cache, directory, hash)) == NULL) {
+        return -1;
+    }
+    record->readTime = (int64_t) time(NULL);
+    if (!readCachedDir(record, directory)) {
+        record->modifiedSeconds = -1;   // incomplete snapshot, read it again next time
+        return -1;
+    }
+    record->device = (uint64_t) dirInfo.st_dev;
+    record->inode = (uint64_t) dirInfo.st_ino;
+    record->modifiedSeconds = (int64_t) dirInfo.st_mtime;
+    record->modifiedNanos = modifiedNanos;
+    cache->misses++;
+    return record - cache->records;
+}
+
+static bool readCachedDir(DirCacheRecord *record, File *directory) {
+    FileIterator iterator;
+    if (!openIterator(&iterator, directory, false, true)) {
+        return false;
+    }
+
+    record->dataLength = record->pathLength + 1;
+    record->childCount = 0;
+    WalkEvent event;
+    while ((event = nextWalkEvent(&iterator)) != WALK_END) {
+        if (event != WALK_ENTRY) continue;
+
+        uint32_t nameLength = iterator.entry.pathLength - (iterator.entryName - iterator.entry.path);
+        if (record->dataLength + nameLength + 2 > record->dataCapacity) {
+            uint32_t capacity = (record->dataLength + nameLength + 2) * 2;
+            char *data = realloc(record->data, capacity);
+            if (data == NULL) {
+                closeFileIterator(&iterator);
+                return false;
+            }
+            record->data = data;
+            record->dataCapacity = capacity;
+        }
+
+        char *entry = record->data + record->dataLength;
+        entry[0] = (char) iterator.entryType;
+        memcpy(entry + 1, iterator.entryName, nameLength + 1);
+        record->dataLength += nameLength + 2;
+        record->childCount++;
+    }
+    closeFileIterator(&iterator);
+    return !iterator.isFailed;     // partially read directory is not cached
+}
+
+static DirCacheRecord *addCachedDir(DirCache *cache, File *directory, uint32_t hash) {
+    if ((cache->recordCount + 1) * 2 > cache->slotCount && !growDirCacheSlots(cache)) {
+        return NULL;
+    }
+
+    if (cache->recordCount >= cache->recordCapacity) {
+        uint32_t capacity = cache->recordCapacity > 0 ? cache->recordCapacity * 2 : DIR_CACHE_MIN_SLOTS / 2;
+        DirCacheRecord *records = realloc(cache->records, capacity * sizeof(DirCacheRecord));
+        if (records == NULL) {
+            return NULL;
+        }
+        cache->records = records;
+        cache->recordCapacity = capacity;
+    }
+
+    DirCacheRecord *record = &cache->records[cache->recordCount];
+    memset(record, 0, sizeof(DirCacheRecord));
+    record->data = malloc(directory->pathLength + 1);
+    if (record->data == NULL) {
+        return NULL;
+    }
+    memcpy(record->data, directory->path, directory->pathLength + 1);
+    record->pathLength = directory->pathLength;
+    record->dataCapacity = directory->pathLength + 1;
+    record->hash = hash;
+
+    uint32_t mask = cache->slotCount - 1;
+    uint32_t slot = hash & mask;
+    while (cache->slots[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    cache->slots[slot] = ++cache->recordCount;
+    return record;
+}
+
+static bool growDirCacheSlots(DirCache *cache) {
+    uint32_t slotCount = cache->slotCount > 0 ? cache->slotCount * 2 : DIR_CACHE_MIN_SLOTS;
+    uint32_t *slots = calloc(slotCount, sizeof(uint32_t));
+    if (slots == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < cache->recordCount; i++) {
+        uint32_t slot = cache->records[i].hash & (slotCount - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slotCount - 1);
+        }
+        slots[slot] = i + 1;
+    }
+    free(cache->slots);
+    cache->slots = slots;
+    cache->slotCount = slotCount;
+    return true;
+}
+
+static uint32_t hashPath(const char *path, uint32_t length) {
+    uint32_t hash = 2166136261u;    // FNV-1a
+    for (uint32_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t) path[i]) * 16777619u;
+    }
+    return hash;
+}
+
+#if defined(__linux__)
+// Adds directory contents to index, each found subdirectory is watched before it is read
+static void scanIndexDir(DirIndex *index, File *directory, bool recursive) {
+    FileIterator iterator;
+    if (!openIterator(&iterator, directory, recursive, false)) {   // links are not followed, one inode is watched once
+        return;
+    }
+
+    WalkEvent event;
+    while ((event = nextWalkEvent(&iterator)) != WALK_END) {
+        if (event != WALK_ENTRY) continue;
+
+        addIndexEntry(index, &iterator.entry, iterator.entryType);
+        if (iterator.entryType == FILE_TYPE_DIRECTORY && recursive) {
+            addIndexWatch(index, &iterator.entry);
+        }
+    }
+    closeFileIterator(&iterator);
+}
+
+// Directory events could be lost, compare its contents with index: add new entries and remove missing
+static void rescanIndexDir(DirIndex *index, uint32_t watchDescriptor) {
+    File directory;
+    DirIndexWatch *watch = &index->watches[watchDescriptor];
+    memcpy(directory.path, watch->path, watch->pathLength + 1);
+    directory.pathLength = watch->pathLength;
+    addIndexWatch(index, &directory);   // refresh modification time
+
+    for (uint32_t i = 0; i < index->slotCount; i++) {
+        DirIndexEntry *entry = &index->entries[i];
+        if (entry->path != NULL && entry->path != removedIndexEntry) {
+            entry->isSeen = !isPathUnder(entry->path, entry->pathLength, directory.path, directory.pathLength) ||
+                            strchr(entry->path + directory.pathLength + 1, FILE_NAME_SEPARATOR_CHAR) != NULL;  // not a direct child
+        }
+    }
+
+    FileIterator iterator;
+    if (openIterator(&iterator, &directory, false, false)) {
+        WalkEvent event;
+        while ((event = nextWalkEvent(&iterator)) != WALK_END) {
+            if (event != WALK_ENTRY) continue;
+
+            File *file = &iterator.entry;
+            DirIndexEntry *entry = findIndexEntry(index, file->path, file->pathLength, hashPath(file->path, file->pathLength));
+            if (entry != NULL && entry->type == iterator.entryType) {
+                entry->isSeen = true;
+                continue;
+            }
+
+            if (entry != NULL) {    // replaced with entry of other type
+                removeIndexEntries(index, file->path, file->pathLength);
+                removeIndexWatches(index, file->path, file->pathLength);
+            }
+            addIndexEntry(index, file, iterator.entryType);
+            if (iterator.entryType == FILE_TYPE_DIRECTORY && addIndexWatch(index, file)) {
+                scanIndexDir(index, file, true);
+            }
+        }
+        closeFileIterator(&iterator);
+    }
+
+    for (uint32_t i = 0; i < index->slotCount; i++) {
+        DirIndexEntry *entry = &index->entries[i];
+        if (entry->path != NULL && entry->path != removedIndexEntry && !entry->isSeen) {
+            File removed;
+            memcpy(removed.path, entry->path, entry->pathLength + 1);
+            removed.pathLength = entry->pathLength;
+            removeIndexEntries(index, removed.path, removed.pathLength);
+            removeIndexWatches(index, removed.path, removed.pathLength);
+        }
+    }
+}
+
+static void applyIndexEvent(DirIndex *index, struct inotify_event *event) {
+    if (event->mask & IN_Q_OVERFLOW) {  // queue doesn't tell whose events were lost, so check all directories times
+        index->overflowCount++;
+        for (uint32_t i = 0; i < index->watchCapacity; i++) {
+            DirIndexWatch *watch = &index->watches[i];
+            struct stat dirInfo;
+            if (watch->path != NULL && stat(watch->path, &dirInfo) == 0 &&
+                (watch->modifiedSeconds != dirInfo.st_mtim.tv_sec || watch->modifiedNanos != dirInfo.st_mtim.tv_nsec)) {
+                rescanIndexDir(index, i);
+            }
+        }
+        return;
+    }
+
+    if (event->wd < 0 || (uint32_t) event->wd >= index->watchCapacity || index->watches[event->wd].path == NULL) {
+        return;     // events for removed watch
+    }
+    DirIndexWatch *watch = &index->watches[event->wd];
+    if (event->mask & IN_IGNORED) {
+        free(watch->path);
+        watch->path = NULL;
+        return;
+    }
+    if (event->len == 0) {
+        return;
+    }
+
+    File file;
+    uint32_t nameLength = strlen(event->name);
+    if (watch->pathLength + nameLength + 1 >= PATH_MAX_LEN) {
+        return;
+    }
+    memcpy(file.path, watch->path, watch->pathLength);
+    file.pathLength = watch->pathLength;
+    if (file.pathLength == 0 || file.path[file.pathLength - 1] != FILE_NAME_SEPARATOR_CHAR) {
+        file.path[file.pathLength++] = FILE_NAME_SEPARATOR_CHAR;
+    }
+    memcpy(file.path + file.pathLength, event->name, nameLength + 1);
+    file.pathLength += nameLength;
+
+    if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        removeIndexEntries(index, file.path, file.pathLength);
+        removeIndexWatches(index, file.path, file.pathLength);  // also for moved out directories, so events from their new place are not applied to old paths
+    } else if (event->mask & (IN_CREATE | IN_MOVED_TO | IN_MODIFY)) {
+        FileType type = FILE_TYPE_DIRECTORY;
+        struct stat entryInfo;
+        if (!(event->mask & IN_ISDIR)) {
+            type = fstatat(AT_FDCWD, file.path, &entryInfo, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(entryInfo.st_mode) ?
+                   FILE_TYPE_REGULAR : FILE_TYPE_OTHER;
+        }
+
+        if (event->mask & IN_MOVED_TO) {   // could replace existing entry
+            removeIndexEntries(index, file.path, file.pathLength);
+            removeIndexWatches(index, file.path, file.pathLength);
+        }
+        bool isNew = addIndexEntry(index, &file, type);
+        if (isNew && type == FILE_TYPE_DIRECTORY && addIndexWatch(index, &file)) {
+            scanIndexDir(index, &file, true);   // created with contents or moved in
+        }
+    }
+}
+
+static bool addIndexWatch(DirIndex *index, File *directory) {
+    int watchDescriptor = inotify_add_watch(index->notifyFd, directory->path, DIR_INDEX_WATCH_MASK);
+    struct stat dirInfo;
+    if (watchDescriptor < 0 || stat(directory->path, &dirInfo) == NO_FILE_INFO) {
+        return false;
+    }
+
+    if ((uint32_t) watchDescriptor >= index->watchCapacity) {
+        uint32_t capacity = (watchDescriptor + 1) * 2;
+        DirIndexWatch *watches = realloc(index->watches, capacity * sizeof(DirIndexWatch));
+        if (watches == NULL) {
+            inotify_rm_watch(index->notifyFd, watchDescriptor);
+            return false;
+        }
+        memset(watches + index->watchCapacity, 0, (capacity - index->watchCapacity) * sizeof(DirIndexWatch));
+        index->watches = watches;
+        index->watchCapacity = capacity;
+    }
+
+    DirIndexWatch *watch = &index->watches[watchDescriptor];
+    if (watch->path == NULL || watch->pathLength != directory->pathLength || memcmp(watch->path, directory->path, directory->pathLength) != 0) {
+        char *path = malloc(directory->pathLength + 1);
+        if (path == NULL) {
+            inotify_rm_watch(index->notifyFd, watchDescriptor);
+            return false;
+        }
+        memcpy(path, directory->path, directory->pathLength + 1);
+        free(watch->path);
+        watch->path = path;
+        watch->pathLength = directory->pathLength;
+    }
+    watch->modifiedSeconds = dirInfo.st_mtim.tv_sec;
+    watch->modifiedNanos = dirInfo.st_mtim.tv_nsec;
+    return true;
+}
+
+// Stops watching directory and its subdirectories
+static void removeIndexWatches(DirIndex *index, const char *path, uint32_t length) {
+    for (uint32_t i = 0; i < index->watchCapacity; i++) {
+        DirIndexWatch *watch = &index->watches[i];
+        if (watch->path != NULL && (isPathUnder(watch->path, watch->pathLength, path, length) ||
+                                    (watch->pathLength == length && memcmp(watch->path, path, length) == 0))) {
+            inotify_rm_watch(index->notifyFd, (int) i);
+            free(watch->path);
+            watch->path = NULL;
+        }
+    }
+}
+
+static DirIndexEntry *findIndexEntry(DirIndex *index, const char *path, uint32_t length, uint32_t hash) {
+    uint32_t mask = index->slotCount - 1;
+    for (uint32_t slot = hash & mask; index->entries[slot].path != NULL; slot = (slot + 1) & mask) {
+        DirIndexEntry *entry = &index->entries[slot];
+        if (entry->path != removedIndexEntry && entry->hash == hash && entry->pathLength == length && memcmp(entry->path, path, length) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Returns 'true' when entry was not in index before
+static bool addIndexEntry(DirIndex *index, File *file, FileType type) {
+    if ((index->usedSlots + 1) * 2 > index->slotCount && !growIndexEntries(index)) {
+        return false;
+    }
+
+    uint32_t hash = hashPath(file->path, file->pathLength);
+    DirIndexEntry *entry = findIndexEntry(index, file->path, file->pathLength, hash);
+    if (entry != NULL) {
+        entry->type = type;
+        entry->isSeen = true;
+        return false;
+    }
+
+    char *path = malloc(file->pathLength + 1);
+    if (path == NULL) {
+        return false;
+    }
+    memcpy(path, file->path, file->pathLength + 1);
+
+    uint32_t mask = index->slotCount - 1;
+    uint32_t slot = hash & mask;
+    while (index->entries[slot].path != NULL && index->entries[slot].path != removedIndexEntry) {
+        slot = (slot + 1) & mask;
+    }
+    if (index->entries[slot].path == NULL) {
+        index->usedSlots++;
+    }
+    index->entries[slot] = (DirIndexEntry) {.path = path, .pathLength = file->pathLength, .hash = hash, .type = type, .isSeen = true};
+    index->entryCount++;
+    return true;
+}
+
+// Removes entry with all its contents when it is a directory
+static void removeIndexEntries(DirIndex *index, const char *path, uint32_t length) {
+    DirIndexEntry *entry = index->slotCount > 0 ? findIndexEntry(index, path, length, hashPath(path, length)) : NULL;
+    if (entry == NULL) {
+        return;
+    }
+
+    bool isDir = entry->type == FILE_TYPE_DIRECTORY;
+    free(entry->path);
+    entry->path = removedIndexEntry;
+    index->entryCount--;
+    if (!isDir) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < index->slotCount; i++) {
+        entry = &index->entries[i];
+        if (entry->path != NULL && entry->path != removedIndexEntry && isPathUnder(entry->path, entry->pathLength, path, length)) {
+            free(entry->path);
+            entry->path = removedIndexEntry;
+            index->entryCount--;
+        }
+    }
+}
+
+static bool growIndexEntries(DirIndex *index) {
+    uint32_t slotCount = DIR_CACHE_MIN_SLOTS;
+    while (slotCount < (index->entryCount + 1) * 4) {   // removed slots are dropped, so table may stay the same size
+        slotCount *= 2;
+    }
+
+    DirIndexEntry *entries = calloc(slotCount, sizeof(DirIndexEntry));
+    if (entries == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < index->slotCount; i++) {
+        DirIndexEntry *entry = &index->entries[i];
+        if (entry->path == NULL || entry->path == removedIndexEntry) continue;
+
+        uint32_t slot = entry->hash & (slotCount - 1);
+        while (entries[slot].path != NULL) {
+            slot = (slot + 1) & (slotCount - 1);
+        }
+        entries[slot] = *entry;
+    }
+    free(index->entries);
+    index->entries = entries;
+    index->slotCount = slotCount;
+    index->usedSlots = index->entryCount;
+    return true;
+}
+
+static bool isPathUnder(const char *path, uint32_t length, const char *parent, uint32_t parentLength) {
+    if (parentLength > 0 && parent[parentLength - 1] == FILE_NAME_SEPARATOR_CHAR) {
+        return length > parentLength && memcmp(path, parent, parentLength) == 0;
+    }
+    return length > parentLength && path[parentLength] == FILE_NAME_SEPARATOR_CHAR && memcmp(path, parent, parentLength) == 0;
+}
+#endif
+
+static inline const unsigned char *getSortedPath(PathSort *sort, uint32_t index) {
+    if (sort->list != NULL) {
+        return (const unsigned char *) sort->list->pathArena + sort->list->pathOffsets[index];
+    }
+    return (const unsigned char *) sort->vec->items[sort->order[index]].path;
+}
+
+static uint32_t getCommonPathPrefix(PathSort *sort, uint32_t low, uint32_t count, uint32_t depth) {
+    const unsigned char *first = getSortedPath(sort, low) + depth;
+    uint32_t common = UINT32_MAX;
+    for (uint32_t i = low + 1; i < low + count && common > 0; i++) {
+        const unsigned char *path = getSortedPath(sort, i) + depth;
+        uint32_t length = 0;
+        while (length < common && first[length] != '\0' && path[length] == first[length]) {
+            length++;
+        }
+        common = length;
+    }
+    return common;
+}
+
+static void sortPaths(PathSort *sort, uint32_t low, uint32_t count, uint32_t depth) {
+    while (count > PATH_SORT_INSERTION_THRESHOLD) {
+        depth += getCommonPathPrefix(sort, low, count, depth);   // skip shared directory part at once, not char by char
+        uint32_t high = low + count - 1;
+        uint32_t middle = low + count / 2;
+        unsigned char lowChar = getSortedPath(sort, low)[depth];
+        unsigned char middleChar = getSortedPath(sort, middle)[depth];
+        unsigned char highChar = getSortedPath(sort, high)[depth];
+        uint32_t pivot = (lowChar < middleChar) ?
+                         (middleChar < highChar ? middle : lowChar < highChar ? high : low) :
+                         (lowChar < highChar ? low : middleChar < highChar ? high : middle);   // median of three
+        swapSortedPaths(sort, low, pivot);
+        int32_t pivotChar = getSortedPath(sort, low)[depth];
+
+        // Partition to: [equal | less | greater | equal], then move equal parts to the middle
+        uint32_t lessStart = low + 1, lessEnd = low + 1;
+        uint32_t greaterStart = high, greaterEnd = high;
+        while (true) {
+            int32_t diff;
+            while (lessEnd <= greaterStart && (diff = getSortedPath(sort, lessEnd)[depth] - pivotChar) <= 0) {
+                if (diff == 0) swapSortedPaths(sort, lessStart++, lessEnd);
+                lessEnd++;
+            }
+            while (lessEnd <= greaterStart && (diff = getSortedPath(sort, greaterStart)[depth] - pivotChar) >= 0) {
+                if (diff == 0) swapSortedPaths(sort, greaterStart, greaterEnd--);
+                greaterStart--;
+            }
+            if (lessEnd > greaterStart) break;
+            swapSortedPaths(sort, lessEnd++, greaterStart--);
+        }
+
+        uint32_t equalLeft = lessStart - low, equalRight = high - greaterEnd;
+        uint32_t swapCount = equalLeft < lessEnd - lessStart ? equalLeft : lessEnd - lessStart;
+        for (uint32_t i = 0; i < swapCount; i++) swapSortedPaths(sort, low + i, lessEnd - swapCount + i);
+        swapCount = equalRight < greaterEnd - greaterStart ? equalRight : greaterEnd - greaterStart;
+        for (uint32_t i = 0; i < swapCount; i++) swapSortedPaths(sort, lessEnd + i, high + 1 - swapCount + i);
+
+        uint32_t lessCount = lessEnd - lessStart;
+        uint32_t greaterCount = greaterEnd - greaterStart;
+        uint32_t equalCount = count - lessCount - greaterCount;
+        sortPaths(sort, low, lessCount, depth);
+        if (pivotChar != '\0') {   // equal paths are sorted by next char, all ended ones are the same
+            sortPaths(sort, low + lessCount, equalCount, depth + 1);
+        }
+        low = low + count - greaterCount;
+        count = greaterCount;
+    }
+    insertionSortPaths(sort, low, count, depth);
+}
+
+static void insertionSortPaths(PathSort *sort, uint32_t low, uint32_t count, uint32_t depth) {
+    for (uint32_t i = low + 1; i < low + count; i++) {
+        for (uint32_t j = i; j > low; j--) {
+            const char *previous = (const char *) getSortedPath(sort, j - 1) + depth;
+            const char *current = (const char *) getSortedPath(sort, j) + depth;
+            if (strcmp(previous, current) <= 0) break;
+            swapSortedPaths(sort, j - 1, j);
+        }
+    }
+}
+
+static void swapSortedPaths(PathSort *sort, uint32_t one, uint32_t two) {
+    if (sort->list != NULL) {
+        FileList *list = sort->list;
+        uint32_t offset = list->pathOffsets[one];
+        list->pathOffsets[one] = list->pathOffsets[two];
+        list->pathOffsets[two] = offset;
+        uint16_t length = list->pathLengths[one];
+        list->pathLengths[one] = list->pathLengths[two];
+        list->pathLengths[two] = length;
+        uint8_t type = list->types[one];
+        list->types[one] = list->types[two];
+        list->types[two] = type;
+        return;
+    }
+
+    uint32_t index = sort->order[one];
+    sort->order[one] = sort->order[two];
+    sort->order[two] = index;
+}
+
+static void copyVecItem(File *dest, File *src) {
+    memcpy(dest->path, src->path, src->pathLength + 1);     // avoid copying whole path buffer
+    dest->pathLength = src->pathLength;
+    dest->file = src->file;
+    dest->dir = src->dir;
+}
+
+static bool isFilterAccepted(FileIterator *iterator, FileFilter *filter) {
+    const char *name = iterator->entryName;
+    if (iterator->entryType == FILE_TYPE_DIRECTORY) {
+        if (filter->excludeDirPattern != NULL && isFileNameMatches(name, filter->excludeDirPattern)) {
+            iterator->isDescendPending = false;     // prune without opening
+            return false;
+        }
+
+        if (filter->maxDepth > 0 && iterator->depth >= filter->maxDepth) {
+            iterator->isDescendPending = false;
+        }
+        return filter->includeDirs;
+    }
+
+    if (!filter->includeDirs && iterator->entryType != FILE_TYPE_REGULAR) {
+        return false;
+    }
+
+    if ((filter->namePattern != NULL && !isFileNameMatches(name, filter->namePattern)) || !isExtensionAccepted(name, filter)) {
+        return false;
+    }
+
+    if (filter->minSize == 0 && filter->maxSize == 0 && filter->modifiedAfter == 0 && filter->modifiedBefore == 0) {
+        return true;
+    }
+
+    struct stat fileInfo;
+#if defined(_WIN32) || defined(_WIN64)
+    if (stat(iterator->entry.path, &fileInfo) == NO_FILE_INFO) {
+#else
+    if (fstatat(dirfd(iterator->dirs[iterator->depth - 1]), name, &fileInfo, 0) == NO_FILE_INFO) {
+#endif
+        return false;
+    }
+
+    uint64_t fileSize = fileInfo.st_size;
+    return (filter->minSize == 0 || fileSize >= filter->minSize) &&
+           (filter->maxSize == 0 || fileSize <= filter->maxSize) &&
+           (filter->modifiedAfter == 0 || fileInfo.st_mtime > filter->modifiedAfter) &&
+           (filter->modifiedBefore == 0 || fileInfo.st_mtime < filter->modifiedBefore);
+}
+
+static bool isExtensionAccepted(const char *name, FileFilter *filter) {
+    if (filter->extensions == NULL || filter->extensionCount == 0) {
+        return true;
+    }
+
+    const char *extension = strrchr(name, '.');
+    if (extension == NULL) {
+        return false;
+    }
+    extension++;
+
+    for (uint32_t i = 0; i < filter->extensionCount; i++) {
+        const char *expected = filter->extensions[i];
+        expected += expected[0] == '.' ? 1 : 0;
+        uint32_t j = 0;
+        while (expected[j] != '\0' && tolower((unsigned char) expected[j]) == tolower((unsigned char) extension[j])) {
+            j++;
+        }
+
+        if (expected[j] == '\0' && extension[j] == '\0') {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool isCharInSet(const char **pattern, char nameChar) {  // '[a-z]' or '[!a-z]', pattern moved after ']'
+    const char *setPattern = *pattern + 1;
+    bool isNegated = *setPattern == '!';
+    setPattern += isNegated ? 1 : 0;
+
+    bool isFound = false;
+    const char *setStart = setPattern;
+    while (*setPattern != '\0' && (*setPattern != ']' || setPattern == setStart)) {
+        if (setPattern[1] == '-' && setPattern[2] != ']' && setPattern[2] != '\0') {
+            isFound |= nameChar >= setPattern[0] && nameChar <= setPattern[2];
+            setPattern += 3;
+        } else {
+            isFound |= nameChar == *setPattern;
+            setPattern++;
+        }
+    }
+
+    if (*setPattern != ']') {     // not closed, treat '[' as usual char
+        *pattern += 1;
+        return nameChar == '[';
+    }
+    *pattern = setPattern + 1;
+    return isFound != isNegated;
+}
+
+static bool removeIteratorEntry(FileIterator *iterator, bool isDir) {
+#if defined(_WIN32) || defined(_WIN64)
+    return (isDir ? rmdir(iterator->entry.path) : remove(iterator->entry.path)) == 0;
+#else
+    int parentDir = dirfd(iterator->dirs[iterator->depth - 1]);
+    return unlinkat(parentDir, iterator->entryName, isDir ? AT_REMOVEDIR : 0) == 0;
+#endif
+}
+
+#ifdef FILE_UTILS_ENABLE_THREADS
+static void *runWalkWorker(void *arg) {
+    WalkWorker *worker = arg;
+    ParallelWalk *walk = worker->walk;
+    File dir;
+
+    while (true) {
+        bool hasDir = takeWalkDir(worker, &dir);
+        for (uint32_t i = 1; !hasDir && i < walk->workerCount; i++) {
+            hasDir = stealWalkDir(&walk->workers[(worker->id + i) % walk->workerCount], &dir);
+        }
+
+        pthread_mutex_lock(&walk->lock);
+        if (hasDir) {
+            walk->queuedDirs--;
+            walk->activeWorkers++;
+            bool isStopped = walk->isStopped;
+            pthread_mutex_unlock(&walk->lock);
+
+            if (!isStopped) {
+                walkDirInParallel(worker, &dir);
+            }
+
+            pthread_mutex_lock(&walk->lock);
+            walk->activeWorkers--;
+            if (walk->activeWorkers == 0 && (walk->queuedDirs <= 0 || walk->isStopped)) {
+                pthread_cond_broadcast(&walk->hasWork);     // wake up idle workers to finish
+            }
+            pthread_mutex_unlock(&walk->lock);
+            continue;
+        }
+
+        while (walk->queuedDirs <= 0 && walk->activeWorkers > 0 && !walk->isStopped) {
+            pthread_cond_wait(&walk->hasWork, &walk->lock);
+        }
+        bool isFinished = walk->isStopped || (walk->queuedDirs <= 0 && walk->activeWorkers == 0);
+        pthread_mutex_unlock(&walk->lock);
+        if (isFinished) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static bool pushWalkDir(WalkWorker *worker, File *dir) {
+    pthread_mutex_lock(&worker->lock);
+    bool isQueueFull = worker->bottom - worker->top >= PARALLEL_WALK_QUEUE_SIZE;
+    if (!isQueueFull) {
+        memcpy(worker->dirQueue[worker->bottom % PARALLEL_WALK_QUEUE_SIZE], dir->path, dir->pathLength + 1);
+        worker->bottom++;
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    if (isQueueFull) {
+        return false;
+    }
+
+    ParallelWalk *walk = worker->walk;
+    pthread_mutex_lock(&walk->lock);
+    walk->queuedDirs++;
+    pthread_cond_signal(&walk->hasWork);
+    pthread_mutex_unlock(&walk->lock);
+    return true;
+}
+
+static bool takeWalkDir(WalkWorker *worker, File *dir) {
+    pthread_mutex_lock(&worker->lock);
+    bool hasDir = worker->bottom != worker->top;
+    if (hasDir) {
+        worker->bottom--;
+        copyQueuedDir(dir, worker->dirQueue[worker->bottom % PARALLEL_WALK_QUEUE_SIZE]);
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return hasDir;
+}
+
+static bool stealWalkDir(WalkWorker *victim, File *dir) {
+    pthread_mutex_lock(&victim->lock);
+    bool hasDir = victim->bottom != victim->top;
+    if (hasDir) {
+        copyQueuedDir(dir, victim->dirQueue[victim->top % PARALLEL_WALK_QUEUE_SIZE]);
+        victim->top++;
+    }
+    pthread_mutex_unlock(&victim->lock);
+    return hasDir;
+}
+
+static void copyQueuedDir(File *dir, const char *queuedPath) {
+    dir->pathLength = strlen(queuedPath);
+    memcpy(dir->path, queuedPath, dir->pathLength + 1);
+}
+
+static void walkDirInParallel(WalkWorker *worker, File *dir) {
+    ParallelWalk *walk = worker->walk;
+    FileIterator iterator;
+    if (!openIterator(&iterator, dir, true, true)) {
+        return;
+    }
+
+    WalkEvent event;
+    while ((event = nextWalkEvent(&iterator)) != WALK_END) {
+        if (event != WALK_ENTRY) continue;
+
+        worker->visitedCount++;
+        if (!walk->visitor(&iterator.entry, iterator.entryType, walk->context)) {
+            pthread_mutex_lock(&walk->lock);
+            walk->isStopped = true;
+            pthread_cond_broadcast(&walk->hasWork);
+            pthread_mutex_unlock(&walk->lock);
+            break;
+        }
+
+        if (iterator.entryType == FILE_TYPE_DIRECTORY && pushWalkDir(worker, &iterator.entry)) {
+            iterator.isDescendPending = false;  // shared with other threads, otherwise walk it in place when queue is full
+        }
+    }
+    closeFileIterator(&iterator);
+}
+
+static bool collectFileToVec(File *file, FileType type, void *context) {
+    if (type != FILE_TYPE_REGULAR) {
+        return true;
+    }
+
+    VecCollector *collector = context;
+    fileVector *vec = collector->vec;
+    pthread_mutex_lock(&collector->lock);
+    bool isAdded = vec->size < vec->capacity;
+    if (isAdded) {
+        File *item = &vec->items[vec->size];
+        memcpy(item->path, file->path, file->pathLength + 1);
+        item->pathLength = file->pathLength;
+        vec->size++;
+    }
+    pthread_mutex_unlock(&collector->lock);
+    return isAdded;
+}
+
+static int compareFilePaths(const void *one, const void *two) {
+    return filePathComparator(*(const File *) one, *(const File *) two);
+}
+#endif
+
+static CopyStrategy copyFileTracked(File *srcFile, File *destFile, CopyMode mode, CopyTracker *tracker) {
+    if (!isFileExists(srcFile)) {
+        return COPY_STRATEGY_NONE;
+    }
+
+    if (destFile == NULL || strcmp(srcFile->path, destFile->path) == 0) {
+        return COPY_STRATEGY_NONE;
+    }
+
+    bool isExclusive = tracker != NULL && tracker->isExclusive;
+    bool isDestExists = isFileExists(destFile);
+    if ((isDestExists && isExclusive) || (!isDestExists && !createFileDirs(destFile))) {
+        return COPY_STRATEGY_NONE;
+    }
+
+#if defined(_WIN32) || defined(_WIN64)
+    if (mode == COPY_MODE_CLONE_ONLY) {
+        return COPY_STRATEGY_NONE;
+    }
+
+    FILE *srcStream = fopen(srcFile->path, "rb");
+    if (srcStream == NULL) {
+        return COPY_STRATEGY_NONE;
+    }
+
+    FILE *destStream = fopen(destFile->path, "wb");
+    if (destStream == NULL) {
+        fclose(srcStream);
+        return COPY_STRATEGY_NONE;
+    }
+
+    char buffer[FILE_COPY_BUFFER_SIZE];
+    size_t length;
+    bool isCopied = true;
+    while (isCopied && (length = fread(buffer, 1, sizeof(buffer), srcStream)) > 0) {
+        isCopied = fwrite(buffer, 1, length, destStream) == length && trackCopiedBytes(tracker, length);
+        countCopySyscalls(tracker, 2);
+    }
+    isCopied = isCopied && !ferror(srcStream);
+
+    fclose(srcStream);
+    isCopied = fclose(destStream) == 0 && isCopied;
+    if (isCopyCancelled(tracker)) {
+        remove(destFile->path);
+    }
+    return isCopied ? COPY_STRATEGY_BLOCKS : COPY_STRATEGY_NONE;
+#else
+    int srcFd = open(srcFile->path, O_RDONLY | O_CLOEXEC);
+    if (srcFd == -1) {
+        return COPY_STRATEGY_NONE;
+    }
+
+    // no O_TRUNC: existing destination is kept until clone succeeds or data copy starts
+    int destFd = open(destFile->path, O_WRONLY | O_CREAT | (isExclusive ? O_EXCL : 0) | O_CLOEXEC, 0666);
+    if (destFd == -1) {
+        close(srcFd);
+        return COPY_STRATEGY_NONE;
+    }
+
+    CopyStrategy strategy = copyFileData(srcFd, destFd, mode, !isDestExists || isExclusive, tracker);
+    close(srcFd);
+    if (close(destFd) != 0) {
+        strategy = COPY_STRATEGY_NONE;
+    }
+    countCopySyscalls(tracker, 4);
+    if (strategy == COPY_STRATEGY_NONE && ((mode == COPY_MODE_CLONE_ONLY && !isDestExists) || isCopyCancelled(tracker))) {
+        unlink(destFile->path);     // don't leave empty file when clone is not supported, or partial copy. Existing file isn't changed by failed clone
+    }
+    return strategy;
+#endif
+}
+
+// Same filesystem move is a rename, data is copied only when rename can't be done. Renamed file counts as copied at once
+static bool moveFileTracked(File *srcFile, File *destDir, MoveMode mode, CopyProgressOptions *options, CopyStats *stats) {
+    if (stats != NULL) {
+        *stats = (CopyStats) {0};
+    }
+    if (!isFileExists(srcFile)) {
+        return false;
+    }
+
+    if (!isDirExists(destDir)) {
+        createSubDirs(destDir);
+        if (MKDIR(destDir->path) != 0) {
+            return false;
+        }
+    }
+
+    BufferString *fileName = EMPTY_STRING(PATH_MAX_LEN);
+    getFileName(srcFile, fileName);
+    File destFile = {0};
+    newFileFromParent(&destFile, destDir, fileName->value);
+    if (strcmp(srcFile->path, destFile.path) == 0) {
+        return false;
+    }
+
+    CopyTracker tracker;
+    startCopyTracker(&tracker, options);
+    tracker.isExclusive = mode == MOVE_MODE_NO_REPLACE;
+    tracker.progress.filesTotal = 1;
+    tracker.progress.bytesTotal = getFileSize(srcFile);
+
+    int error = renamePath(srcFile->path, destFile.path, mode);
+    countCopySyscalls(&tracker, 1);
+    bool isMoved = error == 0;
+    if (isMoved) {
+        tracker.progress.bytesDone = tracker.progress.bytesTotal;
+        tracker.progress.filesDone = 1;
+
+    } else if (isCopyNeededAfterRename(error, mode)) {
+        isMoved = copyFileTracked(srcFile, &destFile, COPY_MODE_CLONE_OR_COPY, &tracker) != COPY_STRATEGY_NONE;
+        if (isMoved && !trackCopiedFile(&tracker)) {
+            tracker.isCancelled = false;    // file is already copied, nothing left to cancel
+        }
+        isMoved = isMoved && remove(srcFile->path) == 0;
+    }
+    finishCopyTracker(&tracker, isMoved, stats);
+    return isMoved;
+}
+
+// Renames whole directory when destination doesn't exist, otherwise entries are renamed into it one by one.
+// Copy is used only for the part that can't be renamed, e.g. destination is on another filesystem
+static bool moveDirTracked(File *srcDir, File *destDir, MoveMode mode, CopyProgressOptions *options, CopyStats *stats) {
+    if (stats != NULL) {
+        *stats = (CopyStats) {0};
+    }
+    if (!isDirExists(srcDir)) {
+        return false;
+    }
+
+    if (isSameOrSubDir(destDir, srcDir)) {
+        return false;       // cannot move directory into itself
+    }
+
+    CopyTracker tracker;
+    startCopyTracker(&tracker, options);
+    tracker.isExclusive = mode == MOVE_MODE_NO_REPLACE;
+    if (!countCopyTotals(srcDir, &tracker)) {
+        return false;
+    }
+
+    int error;
+    if (!isDirExists(destDir)) {
+        createSubDirs(destDir);
+        error = renamePath(srcDir->path, destDir->path, mode);
+        countCopySyscalls(&tracker, 1);
+    } else {
+        error = moveDirEntries(srcDir, destDir, mode);
+        if (error == 0 && rmdir(srcDir->path) != 0) {
+            error = errno;
+        }
+    }
+
+    bool isMoved = error == 0;
+    if (!isMoved && isCopyNeededAfterRename(error, mode)) {
+        isMoved = (isDirExists(destDir) || MKDIR(destDir->path) == 0) && copyDirTree(srcDir, destDir, NULL, &tracker) && deleteDirectory(srcDir);
+    }
+    if (isMoved && tracker.progress.filesDone < tracker.progress.filesTotal) {     // renamed entries are counted as copied at once
+        tracker.progress.bytesDone = tracker.progress.bytesTotal;
+        tracker.progress.filesDone = tracker.progress.filesTotal;
+    }
+    finishCopyTracker(&tracker, isMoved, stats);
+    return isMoved;
+}
+
+// Directories that exist on both sides are merged, their contents is renamed entry by entry. Returns 0 or error of first
+// failed rename, entries that haven't been moved are left in source directory
+static int moveDirEntries(File *srcDir, File *destDir, MoveMode mode) {
+    FileIterator iterator;
+    if (!openIterator(&iterator, srcDir, true, false)) {
+        return errno != 0 ? errno : EIO;
+    }
+
+    int error = 0;
+    WalkEvent event;
+    while (error == 0 && (event = nextWalkEvent(&iterator)) != WALK_END) {
+        if (iterator.isFailed) {
+            error = EIO;    // subdirectory can't be walked, its contents stays in source
+            break;
+        }
+        if (event == WALK_DIR_EXIT) {   // merged directory is empty now
+            error = removeIteratorEntry(&iterator, true) ? 0 : errno;
+            continue;
+        }
+
+        File *destEntry = FILE_OF(destDir, iterator.entry.path + srcDir->pathLength);
+        error = renamePath(iterator.entry.path, destEntry->path, mode);
+        if (error != 0 && iterator.isDescendPending && isDirExists(destEntry)) {
+            error = 0;      // both are directories, walk will move contents
+        } else {
+            iterator.isDescendPending = false;
+        }
+    }
+    closeFileIterator(&iterator);
+    return error == 0 && iterator.isFailed ? EIO : error;
+}
+
+// Returns 0 or errno of failed rename. No replace is atomic with renameat2() on Linux and renamex_np() on macOS,
+// when filesystem doesn't support it, destination is checked before rename
+static int renamePath(const char *srcPath, const char *destPath, MoveMode mode) {
+#if defined(_WIN32) || defined(_WIN64)
+    return rename(srcPath, destPath) == 0 ? 0 : errno;     // never replaces existing destination
+#else
+    if (mode == MOVE_MODE_NO_REPLACE) {
+#if defined(__linux__) && defined(SYS_renameat2)
+        if (syscall(SYS_renameat2, AT_FDCWD, srcPath, AT_FDCWD, destPath, RENAME_NOREPLACE) == 0) {
+            return 0;
+        }
+        if (errno != EINVAL && errno != ENOSYS) {
+            return errno;
+        }
+#elif defined(__APPLE__) && defined(RENAME_EXCL)
+        if (renamex_np(srcPath, destPath, RENAME_EXCL) == 0) {
+            return 0;
+        }
+        if (errno != ENOTSUP) {
+            return errno;
+        }
+#endif
+        struct stat info;
+        if (lstat(destPath, &info) == 0) {
+            return EEXIST;
+        }
+    }
+    return rename(srcPath, destPath) == 0 ? 0 : errno;
+#endif
+}
+
+static bool isCopyNeededAfterRename(int error, MoveMode mode) {
+#if defined(_WIN32) || defined(_WIN64)
+    if (mode == MOVE_MODE_REPLACE && (error == EEXIST || error == EACCES)) {
+        return true;    // rename() doesn't replace files on Windows, copy does
+    }
+#else
+    (void) mode;
+#endif
+    return error == EXDEV;
+}
+
+// Compares paths only, links and relative paths are not resolved
+static bool isSameOrSubDir(File *dir, File *parentDir) {
+    return strncmp(dir->path, parentDir->path, parentDir->pathLength) == 0 &&
+           (dir->path[parentDir->pathLength] == '\0' || dir->path[parentDir->pathLength] == FILE_NAME_SEPARATOR_CHAR);
+}
+
+static void startCopyTracker(CopyTracker *tracker, CopyProgressOptions *options) {
+    *tracker = (CopyTracker) {.options = options};
+    tracker->startTime = getMonotonicSeconds();
+    tracker->lastCallbackTime = tracker->startTime;
+    if (options != NULL) {
+        tracker->nextCallbackBytes = options->callbackBytes;
+        tracker->nextCallbackFiles = options->callbackFiles;
+    }
+}
+
+// Reports final state when last callback didn't see it, then fills stats
+static void finishCopyTracker(CopyTracker *tracker, bool isCopied, CopyStats *stats) {
+    bool isReported = tracker->lastCallbackBytes == tracker->progress.bytesDone && tracker->lastCallbackFiles == tracker->progress.filesDone;
+    if (isCopied && !isReported && tracker->options != NULL && (tracker->options->callbackBytes > 0 || tracker->options->callbackFiles > 0)) {
+        notifyCopyProgress(tracker);
+        tracker->isCancelled = false;   // everything is copied already
+    }
+
+    if (stats != NULL) {
+        stats->bytes = tracker->progress.bytesDone;
+        stats->files = tracker->progress.filesDone;
+        stats->syscalls = tracker->syscalls;
+        stats->seconds = getMonotonicSeconds() - tracker->startTime;
+        stats->isCancelled = tracker->isCancelled;
+    }
+}
+
+// Totals are needed only by callback, so directory is walked in advance only when it's set
+static bool countCopyTotals(File *srcDir, CopyTracker *tracker) {
+    if (tracker->options == NULL || tracker->options->callback == NULL) {
+        return true;
+    }
+
+    FileIterator iterator;
+    if (!openIterator(&iterator, srcDir, true, true)) {
+        return false;
+    }
+    WalkEvent event;
+    while ((event = nextWalkEvent(&iterator)) != WALK_END) {
+        if (event != WALK_ENTRY || iterator.entryType != FILE_TYPE_REGULAR) continue;
+
+        struct stat info;
+#if defined(_WIN32) || defined(_WIN64)
+        if (stat(iterator.entry.path, &info) == 0) {
+#else
+        if (fstatat(dirfd(iterator.dirs[iterator.depth - 1]), iterator.entryName, &info, 0) == 0) {
+#endif
+            tracker->progress.bytesTotal += (uint64_t) info.st_size;
+        }
+        tracker->progress.filesTotal++;
+    }
+    closeFileIterator(&iterator);
+    return true;
+}
+
+// Returns 'false' when copy has been cancelled by callback
+static bool trackCopiedBytes(CopyTracker *tracker, uint64_t length) {
+    if (tracker == NULL) {
+        return true;
+    }
+
+    tracker->progress.bytesDone += length;
+    uint64_t step = tracker->options != NULL ? tracker->options->callbackBytes : 0;
+    if (step > 0 && tracker->progress.bytesDone >= tracker->nextCallbackBytes) {
+        tracker->nextCallbackBytes = (tracker->progress.bytesDone / step + 1) * step;
+        return notifyCopyProgress(tracker);
+    }
+    return !tracker->isCancelled;
+}
+
+static bool trackCopiedFile(CopyTracker *tracker) {
+    if (tracker == NULL) {
+        return true;
+    }
+
+    tracker->progress.filesDone++;
+    uint32_t step = tracker->options != NULL ? tracker->options->callbackFiles : 0;
+    if (step > 0 && tracker->progress.filesDone >= tracker->nextCallbackFiles) {
+        tracker->nextCallbackFiles = (tracker->progress.filesDone / step + 1) * step;
+        return notifyCopyProgress(tracker);
+    }
+    return !tracker->isCancelled;
+}
+
+// Clone shares all data at once, it's counted as copied file size
+static bool trackClonedFile(CopyTracker *tracker, int srcFd) {
+    struct stat info;
+    if (tracker == NULL || fstat(srcFd, &info) != 0) {
+        return true;
+    }
+    tracker->syscalls++;
+    return trackCopiedBytes(tracker, (uint64_t) info.st_size);
+}
+
+static bool notifyCopyProgress(CopyTracker *tracker) {
+    double now = getMonotonicSeconds();
+    CopyProgress *progress = &tracker->progress;
+    double interval = now - tracker->lastCallbackTime;
+    progress->elapsedSeconds = now - tracker->startTime;
+    progress->bytesPerSecond = interval > 0 ? (double) (progress->bytesDone - tracker->lastCallbackBytes) / interval : 0;
+    tracker->lastCallbackTime = now;
+    tracker->lastCallbackBytes = progress->bytesDone;
+    tracker->lastCallbackFiles = progress->filesDone;
+
+    if (tracker->options->callback != NULL && !tracker->options->callback(progress, tracker->options->context)) {
+        tracker->isCancelled = true;
+    }
+    return !tracker->isCancelled;
+}
+
+static void countCopySyscalls(CopyTracker *tracker, uint32_t count) {
+    if (tracker != NULL) {
+        tracker->syscalls += count;
+    }
+}
+
+static bool isCopyCancelled(CopyTracker *tracker) {
+    return tracker != NULL && tracker->isCancelled;
+}
+
+// In-kernel copy is split by callback interval, so progress is reported while large file is copied
+static size_t getCopyChunkSize(CopyTracker *tracker) {
+    uint64_t step = tracker != NULL && tracker->options != NULL ? tracker->options->callbackBytes : 0;
+    if (step == 0 || step >= FILE_COPY_CHUNK_SIZE) {
+        return FILE_COPY_CHUNK_SIZE;
+    }
+    return step < FILE_COPY_BUFFER_SIZE ? FILE_COPY_BUFFER_SIZE : (size_t) step;
+}
+
+static double getMonotonicSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+// Data is copied by kernel without passing it through user space buffers. copy_file_range() can also share or
+// offload blocks on filesystems that support it, sendfile() works between any files on older kernels
+// Not empty destination is truncated only when clone fails and data is copied
+static CopyStrategy copyFileData(int srcFd, int destFd, CopyMode mode, bool isDestEmpty, CopyTracker *tracker) {
+#if defined(__linux__)
+    countCopySyscalls(tracker, 1);
+    if (mode != COPY_MODE_ALWAYS_COPY && ioctl(destFd, FICLONE, srcFd) == 0) {     // fails with EOPNOTSUPP, EXDEV or EINVAL when filesystem can't share blocks
+        struct stat srcInfo;
+        if (!isDestEmpty && (fstat(srcFd, &srcInfo) != 0 || ftruncate(destFd, srcInfo.st_size) != 0)) {
+            return COPY_STRATEGY_NONE;  // clone doesn't shrink longer destination
+        }
+        return trackClonedFile(tracker, srcFd) ? COPY_STRATEGY_CLONE : COPY_STRATEGY_NONE;
+    }
+#endif
+    if (mode == COPY_MODE_CLONE_ONLY) {
+        return COPY_STRATEGY_NONE;
+    }
+
+    if (!isDestEmpty) {
+        countCopySyscalls(tracker, 1);
+        if (ftruncate(destFd, 0) != 0) {
+            return COPY_STRATEGY_NONE;
+        }
+    }
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    struct stat srcInfo;
+    countCopySyscalls(tracker, 1);
+    if (fstat(srcFd, &srcInfo) == 0 && S_ISREG(srcInfo.st_mode) && (uint64_t) srcInfo.st_blocks * 512 < (uint64_t) srcInfo.st_size) {
+        return copySparseFileData(srcFd, destFd, srcInfo.st_size, tracker);     // less space allocated than file size: has holes
+    }
+#endif
+
+#if defined(__linux__)
+    size_t chunkSize = getCopyChunkSize(tracker);
+    uint64_t copiedLength = 0;
+    ssize_t length;
+#ifdef SYS_copy_file_range
+    while ((length = syscall(SYS_copy_file_range, srcFd, NULL, destFd, NULL, chunkSize, 0)) != 0) {
+        countCopySyscalls(tracker, 1);
+        if (length == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        copiedLength += length;
+        if (!trackCopiedBytes(tracker, length)) {
+            return COPY_STRATEGY_NONE;
+        }
+    }
+    if (copiedLength > 0) {     // nothing copied: not supported (ENOSYS, EXDEV, EINVAL), or file like in /proc that reports zero size
+        return length == 0 ? COPY_STRATEGY_COPY_RANGE : COPY_STRATEGY_NONE;
+    }
+#endif
+
+    while ((length = sendfile(destFd, srcFd, NULL, chunkSize)) != 0) {
+        countCopySyscalls(tracker, 1);
+        if (length == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        copiedLength += length;
+        if (!trackCopiedBytes(tracker, length)) {
+            return COPY_STRATEGY_NONE;
+        }
+    }
+    if (copiedLength > 0) {
+        return length == 0 ? COPY_STRATEGY_SENDFILE : COPY_STRATEGY_NONE;
+    }
+#endif
+    return copyFileDataByBlocks(srcFd, destFd, tracker);
+}
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+// Copies only data extents to truncated destination, skipped ranges stay holes that take no disk space
+static CopyStrategy copySparseFileData(int srcFd, int destFd, off_t size, CopyTracker *tracker) {
+    off_t dataStart = 0;
+    while (dataStart < size && (dataStart = lseek(srcFd, dataStart, SEEK_DATA)) != -1) {
+        off_t dataEnd = lseek(srcFd, dataStart, SEEK_HOLE);     // end of file is a hole as well
+        countCopySyscalls(tracker, 2);
+        if (dataEnd == -1 || !copyFileDataRange(srcFd, destFd, dataStart, (dataEnd < size ? dataEnd : size) - dataStart, tracker)) {
+            return COPY_STRATEGY_NONE;
+        }
+        dataStart = dataEnd;
+    }
+
+    if (dataStart == -1 && errno != ENXIO) {   // ENXIO: no data after offset
+        return COPY_STRATEGY_NONE;
+    }
+    countCopySyscalls(tracker, 1);
+    return ftruncate(destFd, size) == 0 ? COPY_STRATEGY_SPARSE : COPY_STRATEGY_NONE;   // hole at the end
+}
+
+static bool copyFileDataRange(int srcFd, int destFd, off_t offset, off_t length, CopyTracker *tracker) {
+#if defined(__linux__) && defined(SYS_copy_file_range)
+    size_t chunkSize = getCopyChunkSize(tracker);
+    int64_t srcOffset = offset;
+    int64_t destOffset = offset;
+    while (length > 0) {
+        size_t chunkLength = length < (off_t) chunkSize ? (size_t) length : chunkSize;
+        ssize_t copiedLength = syscall(SYS_copy_file_range, srcFd, &srcOffset, destFd, &destOffset, chunkLength, 0);
+        countCopySyscalls(tracker, 1);
+        if (copiedLength > 0) {
+            length -= copiedLength;
+            if (!trackCopiedBytes(tracker, copiedLength)) {
+                return false;
+            }
+        } else if (copiedLength == 0 || errno != EINTR) {
+            break;  // not supported or file has been truncated, rest is copied by blocks
+        }
+    }
+    offset = srcOffset;
+#endif
+
+    char buffer[FILE_COPY_BUFFER_SIZE];
+    while (length > 0) {
+        ssize_t readLength = pread(srcFd, buffer, length < (off_t) sizeof(buffer) ? (size_t) length : sizeof(buffer), offset);
+        countCopySyscalls(tracker, 1);
+        if (readLength == -1 && errno == EINTR) continue;
+        if (readLength <= 0) {
+            return readLength == 0;     // source has been truncated during copy
+        }
+
+        for (ssize_t written = 0; written < readLength;) {
+            ssize_t result = pwrite(destFd, buffer + written, readLength - written, offset + written);
+            countCopySyscalls(tracker, 1);
+            if (result == -1) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            written += result;
+        }
+        offset += readLength;
+        length -= readLength;
+        if (!trackCopiedBytes(tracker, readLength)) {
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+static CopyStrategy copyFileDataByBlocks(int srcFd, int destFd, CopyTracker *tracker) {
+    char buffer[FILE_COPY_BUFFER_SIZE];
+    ssize_t length;
+    while ((length = read(srcFd, buffer, sizeof(buffer))) != 0) {
+        countCopySyscalls(tracker, 1);
+        if (length == -1) {
+            if (errno == EINTR) continue;
+            return COPY_STRATEGY_NONE;
+        }
+
+        for (ssize_t written = 0; written < length;) {
+            ssize_t result = write(destFd, buffer + written, length - written);
+            countCopySyscalls(tracker, 1);
+            if (result == -1) {
+                if (errno == EINTR) continue;
+                return COPY_STRATEGY_NONE;
+            }
+            written += result;
+        }
+        if (!trackCopiedBytes(tracker, length)) {
+            return COPY_STRATEGY_NONE;
+        }
+    }
+    countCopySyscalls(tracker, 1);  // read() of the end
+    return COPY_STRATEGY_BLOCKS;
+}
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64)
+// Destination is read once to collect weak checksum of each block, then source is read once and each block is compared
+// with checksum at the same offset. Only when weak checksums match, destination block is read again to compare CRC32.
+// Only changed blocks are written, so unchanged ones keep their disk extents
+static bool copyChangedBlocks(int srcFd, int destFd, DeltaCopyStats *stats) {
+    struct stat srcInfo;
+    struct stat destInfo;
+    if (fstat(srcFd, &srcInfo) != 0 || fstat(destFd, &destInfo) != 0) {
+        return false;
+    }
+
+    uint32_t blockSize = stats->blockSize;
+    uint64_t destSize = (uint64_t) destInfo.st_size;
+    uint64_t signatureCount = (destSize + blockSize - 1) / blockSize;
+    uint32_t *signatures = malloc(signatureCount > 0 ? signatureCount * sizeof(uint32_t) : 1);
+    char *buffer = malloc(blockSize);
+    char *destBuffer = malloc(blockSize);
+    bool isCopied = signatures != NULL && buffer != NULL && destBuffer != NULL;
+
+    for (uint64_t i = 0; isCopied && i < signatureCount; i++) {
+        int64_t length = readBlockAt(destFd, buffer, blockSize, (off_t) (i * blockSize));
+        if (length <= 0) {
+            signatureCount = i;     // destination has been truncated meanwhile, rest is written
+            isCopied = length == 0;
+            break;
+        }
+        signatures[i] = weakBlockChecksum(buffer, (uint32_t) length);
+    }
+
+    uint64_t srcSize = (uint64_t) srcInfo.st_size;
+    for (uint64_t offset = 0; isCopied && offset < srcSize; offset += blockSize) {
+        int64_t length = readBlockAt(srcFd, buffer, blockSize, (off_t) offset);
+        if (length <= 0) {
+            srcSize = offset;       // source has been truncated meanwhile
+            isCopied = length == 0;
+            break;
+        }
+
+        uint64_t index = offset / blockSize;
+        uint64_t destLength = destSize - offset < blockSize ? destSize - offset : blockSize;
+        bool isSame = index < signatureCount && destLength == (uint64_t) length &&
+                      signatures[index] == weakBlockChecksum(buffer, (uint32_t) length);
+        if (isSame) {
+            int64_t destReadLength = readBlockAt(destFd, destBuffer, (uint32_t) length, (off_t) offset);
+            isSame = destReadLength == length &&
+                     generateCRC32(destBuffer, (uint32_t) length) == generateCRC32(buffer, (uint32_t) length);
+        }
+        if (isSame) {
+            stats->bytesSkipped += length;
+            stats->blocksSkipped++;
+        } else {
+            isCopied = writeBlockAt(destFd, buffer, (uint32_t) length, (off_t) offset);
+            stats->bytesTransferred += length;
+            stats->blocksTransferred++;
+        }
+    }
+
+    if (isCopied && srcSize != destSize) {
+        isCopied = ftruncate(destFd, (off_t) srcSize) == 0;
+    }
+    free(signatures);
+    free(buffer);
+    free(destBuffer);
+    return isCopied;
+}
+
+// Returns read length, which is shorter than requested only at the end of file, or -1 on error
+static int64_t readBlockAt(int fd, char *buffer, uint32_t length, off_t offset) {
+    uint32_t readLength = 0;
+    while (readLength < length) {
+        ssize_t result = pread(fd, buffer + readLength, length - readLength, offset + readLength);
+        if (result == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (result == 0) {
+            break;
+        }
+        readLength += result;
+    }
+    return readLength;
+}
+
+static bool writeBlockAt(int fd, const char *buffer, uint32_t length, off_t offset) {
+    for (uint32_t written = 0; written < length;) {
+        ssize_t result = pwrite(fd, buffer + written, length - written, offset + written);
+        if (result == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        written += result;
+    }
+    return true;
+}
+#endif
+
+// rsync weak checksum: byte sum in low half, sum of running sums in high half. It can be rolled by one byte,
+// here blocks are compared only at the same offset, so it is used as fast filter before CRC32
+static uint32_t weakBlockChecksum(const char *data, uint32_t length) {
+    uint32_t sum = 0;
+    uint32_t runningSum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += (uint8_t) data[i];
+        runningSum += sum;
     }
-    return length;
+    return (sum & 0xFFFF) | (runningSum << 16);
 }
 
-static uint32_t removeEndSeparator(char *path, uint32_t length) {
-    if (path[length - 1] == FILE_NAME_SEPARATOR_CHAR) {
-        path[length - 1] = '\0';
-        length--;
+// Copies directory tree, file data is copied by pool workers when 'pool' is set. Links are followed,
+// special files (pipes, sockets, devices and broken links) are skipped
+static bool copyDirTree(File *srcDir, File *destDir, CopyPool *pool, CopyTracker *tracker) {
+    if (isSameOrSubDir(destDir, srcDir)) {
+        return false;       // cannot copy directory to a subdirectory of itself, walk would descend into copied directories
     }
-    return length;
+
+    if (!isDirExists(destDir)) {
+        return false;
+    }
+
+    FileIterator iterator;
+    if (!openIterator(&iterator, srcDir, true, true)) {
+        return false;
+    }
+
+#if defined(_WIN32) || defined(_WIN64)
+    bool isCopied = true;
+    WalkEvent event;
+    while (isCopied && (event = nextWalkEvent(&iterator)) != WALK_END) {
+        if (event != WALK_ENTRY) continue;
+
+        File *copiedFile = FILE_OF(destDir, iterator.entry.path + srcDir->pathLength);
+        if (iterator.entryType == FILE_TYPE_DIRECTORY) {
+            isCopied = MKDIR(copiedFile->path) == 0 || errno == EEXIST;
+        } else if (iterator.entryType == FILE_TYPE_REGULAR) {
+            isCopied = copyFileTracked(&iterator.entry, copiedFile, COPY_MODE_CLONE_OR_COPY, tracker) != COPY_STRATEGY_NONE &&
+                       trackCopiedFile(tracker);
+        }
+    }
+#else
+    int destDirs[MAX_DIR_DEPTH + 1];    // destination directory descriptor for each walk depth
+    destDirs[0] = open(destDir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (destDirs[0] == -1) {
+        closeFileIterator(&iterator);
+        return false;
+    }
+
+    bool isCopied = true;
+    WalkEvent event;
+    while (isCopied && (event = nextWalkEvent(&iterator)) != WALK_END) {
+        int parentDir = destDirs[iterator.depth - 1];
+        if (event == WALK_DIR_EXIT) {
+            close(destDirs[iterator.depth]);
+            countCopySyscalls(tracker, 1);
+            isCopied = !iterator.isFailed;  // source directory contents can't be read
+            continue;
+        }
+
+        if (iterator.entryType == FILE_TYPE_DIRECTORY) {
+            countCopySyscalls(tracker, 2);
+            if (mkdirat(parentDir, iterator.entryName, S_IRWXU | S_IRWXG | S_IRWXO) == -1 && errno != EEXIST) {
+                isCopied = false;
+                break;
+            }
+            destDirs[iterator.depth] = openat(parentDir, iterator.entryName, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            isCopied = destDirs[iterator.depth] != -1;
+            continue;
+        }
+
+        if (iterator.entryType == FILE_TYPE_REGULAR) {
+            isCopied = copyDirEntry(&iterator, parentDir, pool, tracker);
+        }
+    }
+
+    uint32_t openedDirs = isCopied ? 1 : iterator.depth;    // after failure, descriptors of all unfinished levels are still open
+    for (uint32_t i = 0; i < openedDirs; i++) {
+        close(destDirs[i]);
+    }
+#endif
+
+    closeFileIterator(&iterator);
+    return isCopied && !iterator.isFailed;
 }
 
-static uint32_t readFileContents(const char *path, char *buffer, uint32_t length) {
-    FILE *file = fopen(path, "rb");
-    if (file == NULL) return 0;
+#if !defined(_WIN32) && !defined(_WIN64)
+static bool copyDirEntry(FileIterator *iterator, int destDir, CopyPool *pool, CopyTracker *tracker) {
+    int srcFd = openat(dirfd(iterator->dirs[iterator->depth - 1]), iterator->entryName, O_RDONLY | O_CLOEXEC);
+    countCopySyscalls(tracker, 1);
+    if (srcFd == -1) {
+        return false;
+    }
 
-    fseek(file, 0, SEEK_END);
-    uint32_t fileSize = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    fileSize = fileSize >= length ? length : fileSize;
+    int createFlag = tracker != NULL && tracker->isExclusive ? O_EXCL : O_TRUNC;
+    int destFd = openat(destDir, iterator->entryName, O_WRONLY | O_CREAT | createFlag | O_CLOEXEC, 0666);
+    countCopySyscalls(tracker, 1);
+    if (destFd == -1) {
+        close(srcFd);
+        return false;
+    }
 
-    fread(buffer, fileSize, 1, file);
-    fclose(file);
-    buffer[fileSize] = '\0';
-    return fileSize;
+#ifdef FILE_UTILS_ENABLE_THREADS
+    if (pool != NULL) {
+        return pushCopyTask(pool, srcFd, destFd);
+    }
+#else
+    (void) pool;
+#endif
+    bool isCopied = copyFileData(srcFd, destFd, COPY_MODE_CLONE_OR_COPY, true, tracker) != COPY_STRATEGY_NONE;
+    close(srcFd);
+    isCopied = close(destFd) == 0 && isCopied;
+    countCopySyscalls(tracker, 2);
+    if (isCopyCancelled(tracker)) {
+        unlinkat(destDir, iterator->entryName, 0);  // don't leave partially copied file
+        return false;
+    }
+    return isCopied && trackCopiedFile(tracker);
 }
+#endif
 
-static void removeFilesInDir(fileVector *vec) {
-    for (uint32_t i = 0; i < fileVecSize(vec);) {
-        File file = fileVecGet(vec, i);
-        if (isFile(&file)) {
-            remove(file.path);
-            fileVecRemoveAt(vec, i);
-            continue;
+#ifdef FILE_UTILS_ENABLE_THREADS
+static void *runCopyWorker(void *arg) {
+    CopyPool *pool = arg;
+    while (true) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->count == 0 && !pool->isClosed) {
+            pthread_cond_wait(&pool->hasTask, &pool->lock);
+        }
+        if (pool->count == 0) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
         }
 
-        i++;
+        CopyTask task = pool->tasks[pool->head];
+        pool->head = (pool->head + 1) % PARALLEL_COPY_QUEUE_SIZE;
+        pool->count--;
+        pthread_cond_signal(&pool->hasSpace);
+        pthread_mutex_unlock(&pool->lock);
+
+        bool isCopied = copyFileData(task.srcFd, task.destFd, COPY_MODE_CLONE_OR_COPY, true, NULL) != COPY_STRATEGY_NONE;
+        close(task.srcFd);
+        isCopied = close(task.destFd) == 0 && isCopied;
+        if (!isCopied) {
+            pthread_mutex_lock(&pool->lock);
+            pool->isFailed = true;
+            pthread_cond_broadcast(&pool->hasSpace);    // stop the walk waiting for free space
+            pthread_mutex_unlock(&pool->lock);
+        }
     }
 }
 
-static void removeSubDirs(fileVector *vec) {
-    for (uint32_t i = 0; i < fileVecSize(vec);) {
-        File dir = fileVecGet(vec, i);
-        if (rmdir(dir.path) == 0) {
-            fileVecRemoveAt(vec, i);
-            continue;
+static bool pushCopyTask(CopyPool *pool, int srcFd, int destFd) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count == PARALLEL_COPY_QUEUE_SIZE && !pool->isFailed) {
+        pthread_cond_wait(&pool->hasSpace, &pool->lock);
+    }
+
+    bool isPushed = !pool->isFailed;
+    if (isPushed) {
+        pool->tasks[(pool->head + pool->count) % PARALLEL_COPY_QUEUE_SIZE] = (CopyTask) {.srcFd = srcFd, .destFd = destFd};
+        pool->count++;
+        pthread_cond_signal(&pool->hasTask);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!isPushed) {
+        close(srcFd);
+        close(destFd);
+    }
+    return isPushed;
+}
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static FileOp *nextCompletedFileOp(FileOpQueue *queue, bool isWaiting) {
+    if (queue->backend == NULL || queue->inFlight == 0) {
+        return NULL;
+    }
+
+    FileOpBackend *backend = queue->backend;
+    FileOp *op;
+    switch (queue->engine) {
+#if defined(USE_IO_URING)
+        case FILE_OP_ENGINE_IO_URING:   // waiting submits queued operations in the same syscall
+            while ((op = reapIoUringOp(backend)) == NULL && isWaiting && enterIoUring(&backend->ring, 1));
+            break;
+#endif
+#ifdef FILE_UTILS_ENABLE_THREADS
+        case FILE_OP_ENGINE_THREADS:
+            pthread_mutex_lock(&backend->lock);
+            while (isWaiting && backend->completedCount == 0) {
+                pthread_cond_wait(&backend->hasCompleted, &backend->lock);
+            }
+            op = takeCompletedFileOp(backend);
+            pthread_mutex_unlock(&backend->lock);
+            break;
+#endif
+        default:
+            op = takeCompletedFileOp(backend);
+    }
+
+    if (op != NULL) {
+        queue->inFlight--;
+    }
+    return op;
+}
+
+static void executeFileOp(FileOp *op) {
+    int64_t result = -1;
+    switch (op->type) {
+        case FILE_OP_OPEN:
+            result = open(op->path, op->flags, 0666);
+            break;
+        case FILE_OP_READ:
+            result = pread(op->fd, op->buffer, op->length, (off_t) op->offset);
+            break;
+        case FILE_OP_WRITE:
+            result = pwrite(op->fd, op->buffer, op->length, (off_t) op->offset);
+            break;
+        case FILE_OP_CLOSE:
+            result = close(op->fd);
+            break;
+        case FILE_OP_STATX:
+            result = stat(op->path, op->buffer);
+            break;
+    }
+    op->result = result < 0 ? -errno : result;
+}
+
+static void pushCompletedFileOp(FileOpBackend *backend, FileOp *op) {
+    backend->completed[(backend->completedHead + backend->completedCount) % backend->depth] = op;
+    backend->completedCount++;
+}
+
+static FileOp *takeCompletedFileOp(FileOpBackend *backend) {
+    if (backend->completedCount == 0) {
+        return NULL;
+    }
+    FileOp *op = backend->completed[backend->completedHead];
+    backend->completedHead = (backend->completedHead + 1) % backend->depth;
+    backend->completedCount--;
+    return op;
+}
+#endif
+
+#if defined(USE_IO_URING)
+static bool openIoUring(FileOpQueue *queue) {
+    FileOpBackend *backend = queue->backend;
+    IoUring *ring = &backend->ring;
+    struct io_uring_params params = {0};
+    ring->fd = (int) syscall(__NR_io_uring_setup, queue->depth, &params);
+    if (ring->fd < 0) {     // ENOSYS before 5.1, EPERM when disabled by sysctl or seccomp
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {  // open, close and statx operations came along with it in 5.6
+        closeIoUring(backend);
+        return false;
+    }
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool isSingleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (isSingleMap) {
+        ring->sqRingSize = ring->sqRingSize > ring->cqRingSize ? ring->sqRingSize : ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    }
+    ring->sqRing = mapIoUring(ring->fd, ring->sqRingSize, IORING_OFF_SQ_RING);
+    ring->cqRing = isSingleMap ? ring->sqRing : mapIoUring(ring->fd, ring->cqRingSize, IORING_OFF_CQ_RING);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mapIoUring(ring->fd, ring->sqesSize, IORING_OFF_SQES);
+    backend->slots = malloc(queue->depth * sizeof(IoUringSlot));
+    backend->freeSlots = malloc(queue->depth * sizeof(uint32_t));
+    if (ring->sqRing == NULL || ring->cqRing == NULL || ring->sqes == NULL || backend->slots == NULL || backend->freeSlots == NULL) {
+        closeIoUring(backend);
+        return false;
+    }
+
+    char *sqRing = ring->sqRing;
+    char *cqRing = ring->cqRing;
+    ring->sqHead = (uint32_t *) (sqRing + params.sq_off.head);
+    ring->sqTail = (uint32_t *) (sqRing + params.sq_off.tail);
+    ring->sqMask = (uint32_t *) (sqRing + params.sq_off.ring_mask);
+    ring->sqArray = (uint32_t *) (sqRing + params.sq_off.array);
+    ring->sqEntries = params.sq_entries;
+    ring->cqHead = (uint32_t *) (cqRing + params.cq_off.head);
+    ring->cqTail = (uint32_t *) (cqRing + params.cq_off.tail);
+    ring->cqMask = (uint32_t *) (cqRing + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cqRing + params.cq_off.cqes);
+
+    for (uint32_t i = 0; i < queue->depth; i++) {
+        backend->freeSlots[i] = queue->depth - 1 - i;
+    }
+    backend->freeSlotCount = queue->depth;
+    queue->engine = FILE_OP_ENGINE_IO_URING;
+    return true;
+}
+
+static void *mapIoUring(int fd, size_t size, off_t offset) {
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return mapping != MAP_FAILED ? mapping : NULL;
+}
+
+static void closeIoUring(FileOpBackend *backend) {
+    IoUring *ring = &backend->ring;
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    if (ring->cqRing != NULL && ring->cqRing != ring->sqRing) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if (ring->sqRing != NULL) {
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+    close(ring->fd);
+    free(backend->slots);
+    free(backend->freeSlots);
+    *ring = (IoUring) {0};
+    backend->slots = NULL;
+    backend->freeSlots = NULL;
+}
+
+// Adds operation to submission ring, kernel sees it after next io_uring_enter()
+static bool pushIoUringOp(FileOpBackend *backend, FileOp *op) {
+    IoUring *ring = &backend->ring;
+    uint32_t tail = *ring->sqTail;
+    if (backend->freeSlotCount == 0 || tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) == ring->sqEntries) {
+        return false;
+    }
+
+    uint32_t slot = backend->freeSlots[--backend->freeSlotCount];
+    backend->slots[slot].op = op;
+    uint32_t index = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->user_data = slot;
+    switch (op->type) {
+        case FILE_OP_OPEN:
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t) op->path;
+            sqe->len = 0666;    // file mode
+            sqe->open_flags = (uint32_t) op->flags;
+            break;
+        case FILE_OP_READ:
+        case FILE_OP_WRITE:
+            sqe->opcode = op->type == FILE_OP_READ ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe->fd = op->fd;
+            sqe->addr = (uintptr_t) op->buffer;
+            sqe->len = op->length;
+            sqe->off = op->offset;
+            break;
+        case FILE_OP_CLOSE:
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = op->fd;
+            break;
+        case FILE_OP_STATX:
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t) op->path;
+            sqe->len = STATX_BASIC_STATS;   // mask
+            sqe->off = (uintptr_t) &backend->slots[slot].statx;
+            break;
+    }
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->toSubmit++;
+    return true;
+}
+
+// Submits added operations with single syscall, waits for 'minComplete' of them when it's set
+static bool enterIoUring(IoUring *ring, uint32_t minComplete) {
+    while (true) {
+        long submitted = syscall(__NR_io_uring_enter, ring->fd, ring->toSubmit, minComplete, minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (submitted >= 0) {
+            ring->toSubmit -= (uint32_t) submitted;
+            return true;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+static FileOp *reapIoUringOp(FileOpBackend *backend) {
+    IoUring *ring = &backend->ring;
+    uint32_t head = *ring->cqHead;
+    if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+    uint32_t slot = (uint32_t) cqe->user_data;
+    FileOp *op = backend->slots[slot].op;
+    op->result = cqe->res;
+    __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+
+    if (op->type == FILE_OP_STATX && op->result == 0) {
+        statxToStat(&backend->slots[slot].statx, op->buffer);
+    }
+    backend->freeSlots[backend->freeSlotCount++] = slot;
+    return op;
+}
+
+static void statxToStat(struct statx *statx, struct stat *result) {
+    memset(result, 0, sizeof(struct stat));
+    result->st_dev = makedev(statx->stx_dev_major, statx->stx_dev_minor);
+    result->st_ino = statx->stx_ino;
+    result->st_mode = statx->stx_mode;
+    result->st_nlink = statx->stx_nlink;
+    result->st_uid = statx->stx_uid;
+    result->st_gid = statx->stx_gid;
+    result->st_rdev = makedev(statx->stx_rdev_major, statx->stx_rdev_minor);
+    result->st_size = (off_t) statx->stx_size;
+    result->st_blksize = statx->stx_blksize;
+    result->st_blocks = (blkcnt_t) statx->stx_blocks;
+    result->st_atim.tv_sec = statx->stx_atime.tv_sec;
+    result->st_atim.tv_nsec = statx->stx_atime.tv_nsec;
+    result->st_mtim.tv_sec = statx->stx_mtime.tv_sec;
+    result->st_mtim.tv_nsec = statx->stx_mtime.tv_nsec;
+    result->st_ctim.tv_sec = statx->stx_ctime.tv_sec;
+    result->st_ctim.tv_nsec = statx->stx_ctime.tv_nsec;
+}
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64) && defined(FILE_UTILS_ENABLE_THREADS)
+static bool openFileOpWorkers(FileOpQueue *queue) {
+    FileOpBackend *backend = queue->backend;
+    backend->pending = malloc(queue->depth * sizeof(FileOp *));
+    if (backend->pending == NULL) {
+        return false;
+    }
+    pthread_mutex_init(&backend->lock, NULL);
+    pthread_cond_init(&backend->hasPending, NULL);
+    pthread_cond_init(&backend->hasCompleted, NULL);
+
+    for (; backend->workerCount < FILE_OP_QUEUE_THREADS; backend->workerCount++) {
+        if (pthread_create(&backend->workers[backend->workerCount], NULL, runFileOpWorker, backend) != 0) {
+            break;
+        }
+    }
+    if (backend->workerCount == 0) {
+        closeFileOpWorkers(backend);
+        return false;
+    }
+    queue->engine = FILE_OP_ENGINE_THREADS;
+    return true;
+}
+
+static void closeFileOpWorkers(FileOpBackend *backend) {
+    pthread_mutex_lock(&backend->lock);
+    backend->isClosed = true;
+    pthread_cond_broadcast(&backend->hasPending);
+    pthread_mutex_unlock(&backend->lock);
+    for (uint32_t i = 0; i < backend->workerCount; i++) {
+        pthread_join(backend->workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&backend->hasCompleted);
+    pthread_cond_destroy(&backend->hasPending);
+    pthread_mutex_destroy(&backend->lock);
+    free(backend->pending);
+    backend->pending = NULL;
+    backend->workerCount = 0;
+}
+
+static void *runFileOpWorker(void *arg) {
+    FileOpBackend *backend = arg;
+    pthread_mutex_lock(&backend->lock);
+    while (true) {
+        while (backend->pendingCount == 0 && !backend->isClosed) {
+            pthread_cond_wait(&backend->hasPending, &backend->lock);
+        }
+        if (backend->pendingCount == 0) {
+            break;
+        }
+
+        FileOp *op = backend->pending[backend->pendingHead];
+        backend->pendingHead = (backend->pendingHead + 1) % backend->depth;
+        backend->pendingCount--;
+        pthread_mutex_unlock(&backend->lock);
+
+        executeFileOp(op);
+
+        pthread_mutex_lock(&backend->lock);
+        pushCompletedFileOp(backend, op);
+        pthread_cond_signal(&backend->hasCompleted);
+    }
+    pthread_mutex_unlock(&backend->lock);
+    return NULL;
+}
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64) && defined(FILE_UTILS_ENABLE_THREADS)
+static void *runAppendFlusher(void *arg) {
+    AppendWriter *writer = arg;
+    AppendWriterState *state = writer->state;
+    pthread_mutex_lock(&state->lock);
+    while (!state->isFailed) {
+        waitAppendBatch(writer);
+        if (state->queuedBytes == state->takenBytes) {
+            break;      // closing and everything is written
+        }
+
+        AppendBatch batch = {.records = state->queuedRecords, .bytes = state->queuedBytes - state->takenBytes};
+        uint64_t start = state->takenBytes;
+        double batchStartTime = state->batchStartTime;
+        state->takenBytes = state->queuedBytes;
+        state->queuedRecords = 0;
+        state->batchStartTime = 0;
+        state->isFlushRequested = false;
+        pthread_mutex_unlock(&state->lock);
+
+        double writeStartTime = getMonotonicSeconds();      // ring part of the batch isn't changed by appends
+        bool isWritten = writeAppendBatch(state, start, start + batch.bytes, !writer->options.isSyncSkipped);
+        double now = getMonotonicSeconds();
+        batch.writeSeconds = now - writeStartTime;
+        batch.latencySeconds = now - batchStartTime;
+
+        pthread_mutex_lock(&state->lock);
+        if (isWritten) {
+            state->syncedBytes = start + batch.bytes;
+            state->stats.records += batch.records;
+            state->stats.bytes += batch.bytes;
+            state->stats.batches++;
+            state->totalBatchLatency += batch.latencySeconds;
+            if (batch.latencySeconds > state->stats.maxBatchLatency) {
+                state->stats.maxBatchLatency = batch.latencySeconds;
+            }
+        } else {
+            state->isFailed = true;
+        }
+        pthread_cond_broadcast(&state->isSynced);
+        pthread_cond_broadcast(&state->hasSpace);
+
+        if (isWritten && writer->options.batchCallback != NULL) {
+            pthread_mutex_unlock(&state->lock);
+            writer->options.batchCallback(&batch, writer->options.context);
+            pthread_mutex_lock(&state->lock);
+        }
+    }
+    pthread_mutex_unlock(&state->lock);
+    return NULL;
+}
+
+// Called with lock held. Returns when batch is full, its first record has waited flush delay, flush is requested
+// or writer is closing
+static void waitAppendBatch(AppendWriter *writer) {
+    AppendWriterState *state = writer->state;
+    while (state->queuedBytes == state->takenBytes && !state->isClosing) {
+        pthread_cond_wait(&state->hasRecords, &state->lock);
+    }
+
+    while (!state->isClosing && !state->isFlushRequested && state->queuedBytes - state->takenBytes < writer->options.flushBytes) {
+        double waitSeconds = state->batchStartTime + writer->options.flushDelayUs / 1e6 - getMonotonicSeconds();
+        if (waitSeconds <= 0) {
+            break;
+        }
+
+        struct timespec deadline;   // condition variable waits by realtime clock
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t nanoseconds = (uint64_t) deadline.tv_nsec + (uint64_t) (waitSeconds * 1e9);
+        deadline.tv_sec += (time_t) (nanoseconds / 1000000000);
+        deadline.tv_nsec = (long) (nanoseconds % 1000000000);
+        pthread_cond_timedwait(&state->hasRecords, &state->lock, &deadline);
+    }
+}
+
+static bool writeAppendBatch(AppendWriterState *state, uint64_t start, uint64_t end, bool isSynced) {
+    uint32_t ringStart = start % state->capacity;
+    uint64_t length = end - start;
+    uint32_t firstPart = state->capacity - ringStart < length ? state->capacity - ringStart : (uint32_t) length;
+    struct iovec vectors[2] = {
+            {.iov_base = state->buffer + ringStart, .iov_len = firstPart},
+            {.iov_base = state->buffer, .iov_len = length - firstPart}      // wrapped around ring end
+    };
+    if (writeVectors(state->fd, vectors, length > firstPart ? 2 : 1) != length) {
+        return false;
+    }
+    return !isSynced || syncFileData(state->fd);
+}
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64)
+// Writes all vectors, continues after partial writes. Vectors are changed, returns written bytes
+static uint64_t writeVectors(int fd, struct iovec *vectors, int count) {
+    uint64_t total = 0;
+    while (count > 0) {
+        ssize_t written = writev(fd, vectors, count);
+        if (written == -1 && errno == EINTR) continue;
+        if (written <= 0) {
+            break;
+        }
+
+        total += written;
+        while (count > 0 && (size_t) written >= vectors->iov_len) {
+            written -= (ssize_t) vectors->iov_len;
+            vectors++;
+            count--;
+        }
+        if (count > 0) {
+            vectors->iov_base = (char *) vectors->iov_base + written;
+            vectors->iov_len -= written;
+        }
+    }
+    return total;
+}
+
+// Writes whole buffer, continues after partial writes. Returns written bytes
+static uint64_t writeFully(int fd, const char *data, uint64_t length) {
+    uint64_t written = 0;
+    while (written < length) {
+        size_t chunkLength = length - written > SSIZE_MAX ? SSIZE_MAX : (size_t) (length - written);
+        ssize_t count = write(fd, data + written, chunkLength);
+        if (count == -1 && errno == EINTR) continue;
+        if (count <= 0) break;
+        written += count;
+    }
+    return written;
+}
+
+static bool syncFileData(int fd) {
+#if defined(__APPLE__)
+    return fsync(fd) == 0;     // no fdatasync() on macOS
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
+
+static bool fillAtomicTempFile(int fd, const char *data, uint64_t length, struct stat *target, WriteDurability durability) {
+    if (target != NULL && fchmod(fd, target->st_mode & 07777) != 0) {
+        return false;
+    }
+    return writeFully(fd, data, length) == length && (durability == WRITE_DURABILITY_NONE || syncFileData(fd));
+}
+
+// Gives O_TMPFILE file a unique name next to the target, so it can be renamed over it. Sets errno on failure
+static bool linkAtomicTempFile(int fd, const char *path, char *tempPath) {
+    char procPath[64];
+    snprintf(procPath, sizeof(procPath), "/proc/self/fd/%d", fd);
+    for (uint32_t i = 0; i < ATOMIC_WRITE_NAME_ATTEMPTS; i++) {
+        if (!makeAtomicTempPath(path, tempPath)) {
+            errno = ENAMETOOLONG;
+            return false;
         }
+        if (linkat(AT_FDCWD, procPath, AT_FDCWD, tempPath, AT_SYMLINK_FOLLOW) == 0) {
+            return true;
+        }
+        if (errno != EEXIST) return false;
+    }
+    return false;
+}
+
+static bool replaceWithTempFile(const char *tempPath, const char *path, const char *parentPath, WriteDurability durability) {
+    if (rename(tempPath, path) != 0) {
+        unlink(tempPath);
+        return false;
+    }
+    if (durability != WRITE_DURABILITY_FULL) {
+        return true;
+    }
+
+    int dirFd = open(parentPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);   // persist directory entry change
+    if (dirFd == -1) {
+        return false;
+    }
+    bool isSynced = fsync(dirFd) == 0;
+    close(dirFd);
+    return isSynced;
+}
+#endif
+
+// Sibling of target: "<path>.<pid>.<counter>.tmp", counter is shared by all threads
+static bool makeAtomicTempPath(const char *path, char *tempPath) {
+    static uint32_t tempFileCounter = 0;
+    uint32_t counter = __atomic_fetch_add(&tempFileCounter, 1, __ATOMIC_RELAXED);
+#if defined(_WIN32) || defined(_WIN64)
+    unsigned long processId = GetCurrentProcessId();
+#else
+    unsigned long processId = (unsigned long) getpid();
+#endif
+    int length = snprintf(tempPath, PATH_MAX_LEN, "%s.%lu.%u.tmp", path, processId, counter);
+    return length > 0 && length < PATH_MAX_LEN;
+}
+
+static uint32_t concatEndSeparator(char *path, uint32_t length) {
+    if (path[length - 1] != FILE_NAME_SEPARATOR_CHAR) {
+        strcat(path, FILE_NAME_SEPARATOR_STR);
+        length++;
+    }
+    return length;
+}
+
+static uint32_t removeEndSeparator(char *path, uint32_t length) {
+    if (path[length - 1] == FILE_NAME_SEPARATOR_CHAR) {
+        path[length - 1] = '\0';
+        length--;
+    }
+    return length;
+}
+
+// Buffer must have space for null terminator after 'length' bytes
+static uint64_t readFileContents(const char *path, char *buffer, uint64_t length) {
+#if defined(_WIN32) || defined(_WIN64)
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return 0;
+
+    struct _stati64 info;
+    uint64_t fileSize = _fstati64(_fileno(file), &info) == 0 ? (uint64_t) info.st_size : 0;
+    fileSize = fileSize > length ? length : fileSize;
+    fileSize = fread(buffer, 1, (size_t) fileSize, file);
+    fclose(file);
+#else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return 0;
 
-        i++;
+    struct stat info;
+    uint64_t fileSize = fstat(fd, &info) == 0 ? (uint64_t) info.st_size : 0;
+    fileSize = fileSize > length ? length : fileSize;
+    uint64_t readLength = 0;
+    while (readLength < fileSize) {     // single read() returns at most 2 GB on Linux
+        size_t chunkLength = fileSize - readLength > SSIZE_MAX ? SSIZE_MAX : (size_t) (fileSize - readLength);
+        ssize_t count = read(fd, buffer + readLength, chunkLength);
+        if (count == -1 && errno == EINTR) continue;
+        if (count <= 0) break;
+        readLength += count;
     }
+    fileSize = readLength;
+    close(fd);
+#endif
+    buffer[fileSize] = '\0';
+    return fileSize;
 }
 
 static uint32_t removeSizeName(char *text) {
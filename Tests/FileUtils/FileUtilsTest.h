@@ -2,6 +2,15 @@
 
 #include "BaseTestTemplate.h"
 #include "FileUtils.h"
+#include <utime.h>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    #include <fcntl.h>
+#endif
+
+#ifdef FILE_UTILS_ENABLE_THREADS
+    #include <pthread.h>
+#endif
 
 #if defined(_WIN32) || defined(_WIN64)
     #define FROM_PATH "\\tmp"
@@ -188,6 +197,494 @@ static MunitResult testFileList(const MunitParameter params[], void *data) {
     return MUNIT_OK;
 }
 
+static MunitResult testFileIterator(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/iter_dir");
+    deleteDirectory(rootDir);
+
+    File *subDir = FILE_OF(rootDir, "/dir_1/dir_2");
+    assert_true(createSubDirs(subDir));
+    assert_true(MKDIR(subDir->path) == 0);
+    assert_true(createFile(FILE_OF(rootDir, "/file_1.txt")));
+    assert_true(createFile(FILE_OF(rootDir, "/dir_1/file_2.txt")));
+    assert_true(createFile(FILE_OF(subDir, "/file_3.txt")));
+
+    FileIterator iterator;
+    assert_true(openFileIterator(&iterator, rootDir, true));
+    uint32_t fileCount = 0;
+    File *file;
+    while ((file = nextFile(&iterator)) != NULL) {
+        assert_true(isFile(file));
+        assert_true(strstr(file->path, rootDir->path) == file->path);
+        assert_uint32(file->pathLength, ==, strlen(file->path));
+        fileCount++;
+    }
+    closeFileIterator(&iterator);
+    assert_uint32(fileCount, ==, 3);
+
+    assert_true(openFileIterator(&iterator, rootDir, false));
+    uint32_t entryCount = 0;
+    while ((file = nextFileOrDir(&iterator)) != NULL) {
+        assert_true(iterator.entryType == (isDirectory(file) ? FILE_TYPE_DIRECTORY : FILE_TYPE_REGULAR));
+        entryCount++;
+    }
+    closeFileIterator(&iterator);
+    assert_uint32(entryCount, ==, 2);
+
+    // stop in the middle of the walk
+    assert_true(openFileIterator(&iterator, rootDir, true));
+    assert_not_null(nextFileOrDir(&iterator));
+    closeFileIterator(&iterator);
+    assert_null(nextFileOrDir(&iterator));
+
+    assert_false(openFileIterator(&iterator, FILE_OF(rootDir, "/file_1.txt"), true));  // not a directory
+    assert_true(deleteDirectory(rootDir));
+    return MUNIT_OK;
+}
+
+#ifdef FILE_UTILS_ENABLE_THREADS
+static bool countVisitedEntry(File *file, FileType type, void *context) {
+    uint32_t *counters = context;
+    __atomic_fetch_add(&counters[type], 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+static bool stopOnFirstEntry(File *file, FileType type, void *context) {
+    return false;
+}
+
+static MunitResult testListFilesParallel(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/parallel_dir");
+    deleteDirectory(rootDir);
+
+    uint32_t dirCount = 24;
+    uint32_t filesPerDir = 10;
+    for (uint32_t i = 0; i < dirCount; i++) {
+        char name[64];
+        sprintf(name, "dir_%u/sub_%u", i % 6, i);   // nested directories to have work for stealing
+        File *subDir = FILE_OF(rootDir, name);
+        assert_true(createSubDirs(subDir));
+        assert_true(MKDIR(subDir->path) == 0);
+        for (uint32_t j = 0; j < filesPerDir; j++) {
+            sprintf(name, "file_%u.txt", j);
+            assert_true(createFile(FILE_OF(subDir, name)));
+        }
+    }
+
+    uint32_t counters[3] = {0};
+    uint32_t visitedCount = listFilesParallel(rootDir, 4, countVisitedEntry, counters);
+    assert_uint32(counters[FILE_TYPE_REGULAR], ==, dirCount * filesPerDir);
+    assert_uint32(counters[FILE_TYPE_DIRECTORY], ==, dirCount + 6);
+    assert_uint32(visitedCount, ==, dirCount * filesPerDir + dirCount + 6);
+    assert_uint32(listFilesParallel(rootDir, 4, stopOnFirstEntry, NULL), <, visitedCount);
+
+    File *vecBuffer = calloc(dirCount * filesPerDir, sizeof(File));
+    fileVector *vec = NEW_VECTOR_BUFF(File, file, vecBuffer, dirCount * filesPerDir);
+    listFilesParallelToVec(rootDir, vec, 8, true);
+    assert_uint32(fileVecSize(vec), ==, dirCount * filesPerDir);
+    for (uint32_t i = 1; i < fileVecSize(vec); i++) {
+        assert_true(strcmp(vec->items[i - 1].path, vec->items[i].path) < 0);
+    }
+
+    fileVecClear(vec);
+    listFilesParallelToVec(rootDir, vec, 1, false);     // single thread works the same
+    assert_uint32(fileVecSize(vec), ==, dirCount * filesPerDir);
+
+    assert_true(deleteDirectory(rootDir));
+    free(vecBuffer);
+    return MUNIT_OK;
+}
+#endif
+
+static int compareFilePathsInVec(const void *one, const void *two) {
+    return strcmp(((const File *) one)->path, ((const File *) two)->path);
+}
+
+static MunitResult testListFilesBuffered(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/batch_dir");
+    deleteDirectory(rootDir);
+
+    const char *subDirs[] = {"/a", "/a/b", "/a/b/c", "/a/b/c/d", "/e", "/e/f"};
+    for (uint32_t i = 0; i < ARRAY_SIZE(subDirs); i++) {
+        File *subDir = FILE_OF(rootDir, subDirs[i]);
+        assert_true(createSubDirs(subDir));
+        assert_true(MKDIR(subDir->path) == 0 || errno == EEXIST);
+        for (uint32_t j = 0; j < 40; j++) {
+            char name[128];
+            sprintf(name, "file_with_quite_a_long_name_to_fill_read_buffer_faster_%02u.txt", j);
+            assert_true(createFile(FILE_OF(subDir, name)));
+        }
+    }
+
+    uint32_t capacity = 512;
+    File *expectedBuffer = calloc(capacity, sizeof(File));
+    File *actualBuffer = calloc(capacity, sizeof(File));
+    fileVector *expected = NEW_VECTOR_BUFF(File, file, expectedBuffer, capacity);
+    fileVector *actual = NEW_VECTOR_BUFF(File, file, actualBuffer, capacity);
+    listFilesAndDirs(rootDir, expected, true);
+    assert_uint32(fileVecSize(expected), ==, ARRAY_SIZE(subDirs) * 41);
+    qsort(expected->items, expected->size, sizeof(File), compareFilePathsInVec);
+
+    uint32_t bufferSizes[] = {MIN_DIR_READ_BUFFER_SIZE + 3, 3 * MIN_DIR_READ_BUFFER_SIZE, ONE_MB, 16};  // small buffers force re-reading dropped batches
+    for (uint32_t i = 0; i < ARRAY_SIZE(bufferSizes); i++) {
+        char *buffer = malloc(bufferSizes[i]);
+        fileVecClear(actual);
+        listFilesAndDirsBuffered(rootDir, actual, true, buffer, bufferSizes[i]);
+        assert_uint32(fileVecSize(actual), ==, fileVecSize(expected));
+        qsort(actual->items, actual->size, sizeof(File), compareFilePathsInVec);
+        for (uint32_t j = 0; j < fileVecSize(actual); j++) {
+            assert_string_equal(actual->items[j].path, expected->items[j].path);
+        }
+
+        fileVecClear(actual);
+        listFilesBuffered(FILE_OF(rootDir, "/a"), actual, false, buffer, bufferSizes[i]);
+        assert_uint32(fileVecSize(actual), ==, 40);
+        free(buffer);
+    }
+
+    char buffer[MIN_DIR_READ_BUFFER_SIZE * 2];
+    FileIterator iterator;
+    assert_true(openFileIteratorBuffered(&iterator, rootDir, true, buffer, sizeof(buffer)));
+    uint32_t fileCount = 0;
+    while (nextFile(&iterator) != NULL) {
+        fileCount++;
+    }
+    closeFileIterator(&iterator);
+    assert_uint32(fileCount, ==, ARRAY_SIZE(subDirs) * 40);
+
+    assert_true(deleteDirectory(rootDir));
+    free(expectedBuffer);
+    free(actualBuffer);
+    return MUNIT_OK;
+}
+
+static MunitResult testCompactFileList(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/list_dir");
+    deleteDirectory(rootDir);
+
+    File *subDir = FILE_OF(rootDir, "/dir_1/dir_2");
+    assert_true(createSubDirs(subDir));
+    assert_true(MKDIR(subDir->path) == 0);
+    File *file_1 = FILE_OF(rootDir, "/file_1.txt");
+    File *file_2 = FILE_OF(subDir, "/file_2.txt");
+    assert_true(createFile(file_1));
+    assert_true(createFile(file_2));
+
+    FileList *list = NEW_FILE_LIST(16, 1024);
+    assert_not_null(list);
+    assert_true(listFilesToList(rootDir, list, true));
+    assert_uint32(list->size, ==, 2);
+    for (uint32_t i = 0; i < list->size; i++) {
+        const char *path = fileListPath(list, i);
+        assert_true(strcmp(path, file_1->path) == 0 || strcmp(path, file_2->path) == 0);
+        assert_uint32(list->pathLengths[i], ==, strlen(path));
+        assert_uint8(list->types[i], ==, FILE_TYPE_REGULAR);
+
+        File *file = FILE_LIST_GET(list, i);
+        assert_string_equal(file->path, path);
+        assert_true(isFile(file));
+    }
+    assert_null(fileListPath(list, list->size));
+    assert_null(FILE_LIST_GET(list, list->size));
+
+    clearFileList(list);
+    assert_true(listFilesAndDirsToList(rootDir, list, true));
+    assert_uint32(list->size, ==, 4);
+    uint32_t dirCount = 0;
+    for (uint32_t i = 0; i < list->size; i++) {
+        dirCount += list->types[i] == FILE_TYPE_DIRECTORY ? 1 : 0;
+    }
+    assert_uint32(dirCount, ==, 2);
+
+    FileList *smallList = NEW_FILE_LIST(1, 1024);    // not enough entries
+    assert_false(listFilesAndDirsToList(rootDir, smallList, true));
+    assert_uint32(smallList->size, ==, 1);
+
+    smallList = NEW_FILE_LIST(16, 8);   // not enough space for paths
+    assert_false(listFilesToList(rootDir, smallList, true));
+    assert_uint32(smallList->size, ==, 0);
+
+    char buffer[8];
+    assert_null(newFileList(&(FileList){0}, buffer, sizeof(buffer), 16));
+
+    assert_true(deleteDirectory(rootDir));
+    return MUNIT_OK;
+}
+
+static MunitResult testSortedListing(const MunitParameter params[], void *data) {
+    uint32_t pathCount = 500;
+    FileList *list = NEW_FILE_LIST(500, 500 * 64);
+    File *vecBuffer = calloc(pathCount, sizeof(File));
+    fileVector *vec = NEW_VECTOR_BUFF(File, file, vecBuffer, pathCount);
+    File *expected = calloc(pathCount, sizeof(File));
+    uint32_t *order = calloc(pathCount, sizeof(uint32_t));
+
+    uint32_t seed = 7;
+    for (uint32_t i = 0; i < pathCount; i++) {  // long common prefixes, duplicates and paths being prefixes of others
+        seed = seed * 1103515245 + 12345;
+        char path[64];
+        uint32_t length = sprintf(path, "/tmp/dir/sort/dir_%u/sub_%u", (seed >> 8) % 7, (seed >> 16) % 13);
+        if ((seed >> 4) % 3 != 0) {
+            length += sprintf(path + length, "/file_%u.txt", (seed >> 20) % 50);
+        }
+        FileType type = (seed >> 4) % 3 != 0 ? FILE_TYPE_REGULAR : FILE_TYPE_DIRECTORY;
+        assert_true(addToFileList(list, path, length, type));
+        assert_true(fileVecAdd(vec, *NEW_FILE(path)));
+        expected[i] = *NEW_FILE(path);
+    }
+    qsort(expected, pathCount, sizeof(File), compareFilePathsInVec);
+
+    sortFileList(list);
+    sortFileVector(vec, order);
+    assert_uint32(list->size, ==, pathCount);
+    assert_uint32(fileVecSize(vec), ==, pathCount);
+    for (uint32_t i = 0; i < pathCount; i++) {
+        const char *path = fileListPath(list, i);
+        assert_string_equal(path, expected[i].path);
+        assert_uint32(list->pathLengths[i], ==, strlen(path));
+        assert_uint8(list->types[i], ==, strstr(path, "file_") != NULL ? FILE_TYPE_REGULAR : FILE_TYPE_DIRECTORY);
+        assert_string_equal(vec->items[i].path, expected[i].path);
+        assert_uint32(vec->items[i].pathLength, ==, expected[i].pathLength);
+    }
+
+    sortFileVector(vec, order);     // already sorted stays the same
+    for (uint32_t i = 0; i < pathCount; i++) {
+        assert_string_equal(vec->items[i].path, expected[i].path);
+    }
+
+    free(order);
+    free(expected);
+    free(vecBuffer);
+    return MUNIT_OK;
+}
+
+static void setPastModifiedTime(File *file) {
+    struct utimbuf times = {.actime = time(NULL) - 60, .modtime = time(NULL) - 60};
+    assert_true(utime(file->path, &times) == 0);
+}
+
+static MunitResult testCachedListing(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/cache_dir");
+    deleteDirectory(rootDir);
+
+    File *subDir = FILE_OF(rootDir, "/dir_1/dir_2");
+    assert_true(createSubDirs(subDir));
+    assert_true(MKDIR(subDir->path) == 0);
+    assert_true(createFile(FILE_OF(rootDir, "/file_1.txt")));
+    assert_true(createFile(FILE_OF(subDir, "/file_2.txt")));
+    setPastModifiedTime(rootDir);   // directories changed in the same second as read are not trusted
+    setPastModifiedTime(FILE_OF(rootDir, "/dir_1"));
+    setPastModifiedTime(subDir);
+
+    DirCache cache;
+    initDirCache(&cache);
+    fileVector *expected = NEW_VECTOR_64(file);
+    fileVector *vec = NEW_VECTOR_64(file);
+    listFilesAndDirs(rootDir, expected, true);
+    listFilesAndDirsCached(&cache, rootDir, vec, true);
+    assert_uint32(cache.misses, ==, 3);
+    assert_uint32(cache.hits, ==, 0);
+    assert_uint32(fileVecSize(vec), ==, fileVecSize(expected));
+    for (uint32_t i = 0; i < fileVecSize(vec); i++) {
+        assert_string_equal(vec->items[i].path, expected->items[i].path);   // same walk order
+    }
+
+    fileVecClear(vec);
+    listFilesCached(&cache, rootDir, vec, true);
+    assert_uint32(cache.misses, ==, 3);
+    assert_uint32(cache.hits, ==, 3);
+    assert_uint32(fileVecSize(vec), ==, 2);
+
+    File *addedFile = FILE_OF(subDir, "/file_3.txt");  // only changed directory is read again
+    assert_true(createFile(addedFile));
+    fileVecClear(vec);
+    listFilesCached(&cache, rootDir, vec, true);
+    assert_uint32(cache.misses, ==, 4);
+    assert_uint32(cache.hits, ==, 5);
+    assert_uint32(fileVecSize(vec), ==, 3);
+    assert_true(fileVecContains(vec, *addedFile));
+
+    fileVecClear(vec);
+    listFilesCached(&cache, rootDir, vec, false);
+    assert_uint32(fileVecSize(vec), ==, 1);
+    assert_uint32(cache.hits, ==, 6);
+
+    fileVecClear(vec);
+    listFilesCached(&cache, FILE_OF(rootDir, "/file_1.txt"), vec, true);    // not a directory
+    assert_uint32(fileVecSize(vec), ==, 0);
+
+    freeDirCache(&cache);
+    assert_uint32(cache.recordCount, ==, 0);
+    assert_uint32(cache.hits, ==, 0);
+    assert_true(deleteDirectory(rootDir));
+    return MUNIT_OK;
+}
+
+#if defined(__linux__)
+static MunitResult testDirIndex(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/index_dir");
+    deleteDirectory(rootDir);
+    File *outsideDir = NEW_FILE(FROM_PATH "/index_moved_dir");
+    deleteDirectory(outsideDir);
+
+    File *subDir = FILE_OF(rootDir, "/dir_1");
+    assert_true(createSubDirs(subDir));
+    assert_true(MKDIR(subDir->path) == 0);
+    File *file_1 = FILE_OF(rootDir, "/file_1.txt");
+    assert_true(createFile(file_1));
+
+    DirIndex index;
+    assert_true(openDirIndex(&index, rootDir));
+    assert_uint32(index.entryCount, ==, 2);
+    assert_true(isInDirIndex(&index, file_1));
+    assert_true(isInDirIndex(&index, subDir));
+    assert_false(isInDirIndex(&index, rootDir));
+
+    File *file_2 = FILE_OF(subDir, "/file_2.txt");
+    File *newDir = FILE_OF(subDir, "/dir_2");
+    File *file_3 = FILE_OF(newDir, "/file_3.txt");
+    assert_true(createFile(file_2));
+    assert_true(MKDIR(newDir->path) == 0);
+    assert_true(createFile(file_3));    // could be created before directory watch is added
+    assert_true(remove(file_1->path) == 0);
+    assert_uint32(updateDirIndex(&index), >, 0);
+    assert_uint32(index.entryCount, ==, 4);
+    assert_true(isInDirIndex(&index, file_2));
+    assert_true(isInDirIndex(&index, newDir));
+    assert_true(isInDirIndex(&index, file_3));
+    assert_false(isInDirIndex(&index, file_1));
+
+    fileVector *vec = NEW_VECTOR_64(file);
+    dirIndexToVec(&index, vec, false);
+    assert_uint32(fileVecSize(vec), ==, 2);
+    assert_true(fileVecContains(vec, *file_2));
+    assert_true(fileVecContains(vec, *file_3));
+
+    assert_true(rename(subDir->path, outsideDir->path) == 0);  // moved out with contents
+    updateDirIndex(&index);
+    assert_uint32(index.entryCount, ==, 0);
+    assert_uint32(updateDirIndex(&index), ==, 0);
+
+    assert_true(rename(outsideDir->path, subDir->path) == 0);  // moved back
+    updateDirIndex(&index);
+    assert_uint32(index.entryCount, ==, 4);
+    assert_true(isInDirIndex(&index, file_3));
+    assert_true(createFile(FILE_OF(newDir, "/file_4.txt")));     // new directory watch works
+    updateDirIndex(&index);
+    assert_uint32(index.entryCount, ==, 5);
+
+    closeDirIndex(&index);
+    assert_false(openDirIndex(&index, file_2));    // not a directory
+    assert_true(deleteDirectory(rootDir));
+    return MUNIT_OK;
+}
+
+static MunitResult testDirIndexOverflow(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/index_overflow_dir");
+    deleteDirectory(rootDir);
+    File *subDir = FILE_OF(rootDir, "/dir_1");
+    assert_true(createSubDirs(subDir));
+    assert_true(MKDIR(subDir->path) == 0);
+
+    FILE *limitFile = fopen("/proc/sys/fs/inotify/max_queued_events", "r");
+    uint32_t eventLimit = 0;
+    if (limitFile == NULL || fscanf(limitFile, "%u", &eventLimit) != 1 || eventLimit > 100000) {
+        if (limitFile != NULL) fclose(limitFile);
+        assert_true(deleteDirectory(rootDir));
+        return MUNIT_SKIP;
+    }
+    fclose(limitFile);
+
+    DirIndex index;
+    assert_true(openDirIndex(&index, rootDir));
+    for (uint32_t i = 0; i <= eventLimit; i++) {    // each file makes IN_CREATE event
+        char name[32];
+        sprintf(name, "/file_%u.txt", i);
+        assert_true(createFile(FILE_OF(subDir, name)));
+    }
+    assert_true(remove(FILE_OF(subDir, "/file_0.txt")->path) == 0);     // lost event
+
+    updateDirIndex(&index);
+    assert_uint32(index.overflowCount, ==, 1);
+    assert_uint32(index.entryCount, ==, eventLimit + 1);   // files and 'dir_1'
+    assert_false(isInDirIndex(&index, FILE_OF(subDir, "/file_0.txt")));
+    assert_true(isInDirIndex(&index, FILE_OF(subDir, "/file_1.txt")));
+
+    closeDirIndex(&index);
+    assert_true(deleteDirectory(rootDir));
+    return MUNIT_OK;
+}
+#endif
+
+static MunitResult testListFilesFiltered(const MunitParameter params[], void *data) {
+    assert_true(isFileNameMatches("report_2023.csv", "report_*.csv"));
+    assert_true(isFileNameMatches("report_2023.csv", "*"));
+    assert_true(isFileNameMatches("a.txt", "?.txt"));
+    assert_true(isFileNameMatches("log_7.txt", "log_[0-9].txt"));
+    assert_true(isFileNameMatches("log_x.txt", "log_[!0-9].txt"));
+    assert_true(isFileNameMatches("abcabd", "*ab?"));
+    assert_false(isFileNameMatches("log_x.txt", "log_[0-9].txt"));
+    assert_false(isFileNameMatches("report.csv", "report_*.csv"));
+    assert_false(isFileNameMatches("a.txt", NULL));
+
+    File *rootDir = NEW_FILE(FROM_PATH "/filter_dir");
+    deleteDirectory(rootDir);
+
+    File *subDir = FILE_OF(rootDir, "/dir_1/dir_2");
+    File *cacheDir = FILE_OF(rootDir, "/cache");
+    assert_true(createSubDirs(subDir));
+    assert_true(MKDIR(subDir->path) == 0);
+    assert_true(MKDIR(cacheDir->path) == 0);
+    assert_true(createFile(FILE_OF(rootDir, "/a.txt")));
+    assert_true(createFile(FILE_OF(rootDir, "/b.LOG")));
+    assert_true(createFile(FILE_OF(rootDir, "/c.bin")));
+    assert_true(createFile(FILE_OF(subDir, "/d.txt")));
+    assert_true(createFile(FILE_OF(cacheDir, "/e.txt")));
+
+    File *bigFile = FILE_OF(rootDir, "/dir_1/big.txt");
+    assert_true(createFile(bigFile));
+    char *message = "Some test message";
+    assert_uint32(writeCharsToFile(bigFile, message, strlen(message), false), ==, strlen(message));
+
+    fileVector *vec = NEW_VECTOR_64(file);
+    const char *extensions[] = {"txt", ".log"};
+    FileFilter filter = {.extensions = extensions, .extensionCount = ARRAY_SIZE(extensions)};
+    listFilesFiltered(rootDir, vec, &filter);
+    assert_uint32(fileVecSize(vec), ==, 5);
+    fileVecClear(vec);
+
+    filter.excludeDirPattern = "cache";
+    listFilesFiltered(rootDir, vec, &filter);
+    assert_uint32(fileVecSize(vec), ==, 4);
+    assert_false(fileVecContains(vec, *FILE_OF(cacheDir, "/e.txt")));
+    fileVecClear(vec);
+
+    filter.maxDepth = 1;
+    listFilesFiltered(rootDir, vec, &filter);
+    assert_uint32(fileVecSize(vec), ==, 2);
+    fileVecClear(vec);
+
+    FileFilter sizeFilter = {.namePattern = "*.txt", .minSize = 1};
+    listFilesFiltered(rootDir, vec, &sizeFilter);
+    assert_uint32(fileVecSize(vec), ==, 1);
+    assert_string_equal(fileVecGet(vec, 0).path, bigFile->path);
+    fileVecClear(vec);
+
+    FileFilter timeFilter = {.modifiedAfter = time(NULL) + 3600};
+    listFilesFiltered(rootDir, vec, &timeFilter);
+    assert_uint32(fileVecSize(vec), ==, 0);
+    timeFilter = (FileFilter) {.modifiedBefore = time(NULL) + 3600, .includeDirs = true, .excludeDirPattern = "dir_[0-9]"};
+    listFilesFiltered(rootDir, vec, &timeFilter);
+    assert_uint32(fileVecSize(vec), ==, 5);    // 3 files in root, cache dir and file in it
+
+    FileList *list = NEW_FILE_LIST(16, 1024);
+    FileFilter dirFilter = {.namePattern = "none", .includeDirs = true};
+    assert_true(listFilesFilteredToList(rootDir, list, &dirFilter));
+    assert_uint32(list->size, ==, 3);
+
+    assert_true(deleteDirectory(rootDir));
+    return MUNIT_OK;
+}
+
 static MunitResult testCopyFileAndDir(const MunitParameter params[], void *data) {
     // Copy file
     File *rootDir = NEW_FILE(FROM_PATH "/dir1");
@@ -220,6 +717,16 @@ static MunitResult testCopyFileAndDir(const MunitParameter params[], void *data)
     listFilesAndDirs(copyDir, vec, true);
     assert_uint32(fileVecSize(vec), ==, 3);
 
+    // Copy dir into own subdirectory is rejected before anything is created
+    File *nestedDir = FILE_OF(rootDir, "/dir2/nested");
+    assert_true(MKDIR(nestedDir->path) == 0);
+    assert_false(copyDirectory(rootDir, nestedDir));
+    assert_false(copyDirectoryWithProgress(rootDir, nestedDir, NULL, NULL));
+#ifdef FILE_UTILS_ENABLE_THREADS
+    assert_false(copyDirectoryParallel(rootDir, nestedDir, 4));
+#endif
+    assert_true(isEmptyDir(nestedDir));
+
     // Cleanup
     deleteDirectory(rootDir);
     deleteDirectory(copyDir);
@@ -227,6 +734,675 @@ static MunitResult testCopyFileAndDir(const MunitParameter params[], void *data)
     return MUNIT_OK;
 }
 
+static MunitResult testCopyFileContents(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/copy_data_dir");
+    deleteDirectory(rootDir);
+    File *src = FILE_OF(rootDir, "/src.bin");
+    File *dest = FILE_OF(rootDir, "/sub/dest.bin");    // parent directory is created
+    assert_true(createFileDirs(src));
+    assert_true(createFile(src));
+
+    uint32_t length = FILE_COPY_BUFFER_SIZE * 3 + 123;  // more than one block for read()/write() copy
+    char *content = malloc(length);
+    char *copied = malloc(length + 1);
+    for (uint32_t i = 0; i < length; i++) {
+        content[i] = (char) (i * 31 + i / 7);
+    }
+    assert_uint32(writeCharsToFile(src, content, length, false), ==, length);
+
+    assert_true(copyFile(src, dest));
+    assert_uint64(getFileSize(dest), ==, length);
+    assert_uint32(readFileToBuffer(dest, copied, length + 1), ==, length);
+    assert_memory_equal(length, copied, content);
+
+    assert_uint32(writeCharsToFile(src, "short", 5, false), ==, 5);    // existing destination is truncated
+    assert_true(copyFile(src, dest));
+    assert_uint64(getFileSize(dest), ==, 5);
+
+    assert_uint32(writeCharsToFile(src, "", 0, false), ==, 0);  // empty
+    assert_true(copyFile(src, dest));
+    assert_uint64(getFileSize(dest), ==, 0);
+
+#if defined(__linux__)
+    assert_true(copyFile(NEW_FILE("/proc/self/mounts"), dest));    // reports zero size, but has content
+    assert_uint64(getFileSize(dest), >, 0);
+#endif
+
+    assert_false(copyFile(src, src));
+    assert_false(copyFile(FILE_OF(rootDir, "/missing.bin"), dest));
+
+    free(content);
+    free(copied);
+    assert_true(deleteDirectory(rootDir));
+    return MUNIT_OK;
+}
+
+static MunitResult testCopyFileWithMode(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/copy_mode_dir");
+    deleteDirectory(rootDir);
+    File *src = FILE_OF(rootDir, "/src.txt");
+    File *dest = FILE_OF(rootDir, "/dest.txt");
+    assert_true(createFileDirs(src));
+    assert_true(createFile(src));
+    char *message = "Some test message";
+    assert_uint32(writeCharsToFile(src, message, strlen(message), false), ==, strlen(message));
+
+    char buffer[64];
+    CopyStrategy strategy = copyFileWithMode(src, dest, COPY_MODE_CLONE_ONLY);
+    if (strategy == COPY_STRATEGY_CLONE) {  // btrfs, XFS with reflink
+        assert_uint32(readFileToBuffer(dest, buffer, sizeof(buffer)), ==, strlen(message));
+        assert_string_equal(buffer, message);
+        assert_true(remove(dest->path) == 0);
+    } else {    // tmpfs, ext4: nothing is copied
+        assert_int(strategy, ==, COPY_STRATEGY_NONE);
+        assert_false(isFileExists(dest));
+    }
+
+    strategy = copyFileWithMode(src, dest, COPY_MODE_CLONE_OR_COPY);
+    assert_int(strategy, !=, COPY_STRATEGY_NONE);
+    assert_uint32(readFileToBuffer(dest, buffer, sizeof(buffer)), ==, strlen(message));
+    assert_string_equal(buffer, message);
+
+    strategy = copyFileWithMode(src, dest, COPY_MODE_ALWAYS_COPY);
+    assert_int(strategy, !=, COPY_STRATEGY_NONE);
+    assert_int(strategy, !=, COPY_STRATEGY_CLONE);
+    assert_uint32(readFileToBuffer(dest, buffer, sizeof(buffer)), ==, strlen(message));
+    assert_string_equal(buffer, message);
+
+    // existing longer destination: changed only by successful clone, truncated before data copy
+    char *oldMessage = "Old destination message, longer than source";
+    assert_uint32(writeCharsToFile(dest, oldMessage, strlen(oldMessage), false), ==, strlen(oldMessage));
+    strategy = copyFileWithMode(src, dest, COPY_MODE_CLONE_ONLY);
+    memset(buffer, 0, sizeof(buffer));
+    readFileToBuffer(dest, buffer, sizeof(buffer));
+    assert_string_equal(buffer, strategy == COPY_STRATEGY_CLONE ? message : oldMessage);
+
+    assert_uint32(writeCharsToFile(dest, oldMessage, strlen(oldMessage), false), ==, strlen(oldMessage));
+    assert_int(copyFileWithMode(src, dest, COPY_MODE_CLONE_OR_COPY), !=, COPY_STRATEGY_NONE);
+    assert_uint64(getFileSize(dest), ==, strlen(message));
+
+    assert_uint32(writeCharsToFile(dest, oldMessage, strlen(oldMessage), false), ==, strlen(oldMessage));
+    assert_int(copyFileWithMode(src, dest, COPY_MODE_ALWAYS_COPY), !=, COPY_STRATEGY_NONE);
+    memset(buffer, 0, sizeof(buffer));
+    assert_uint32(readFileToBuffer(dest, buffer, sizeof(buffer)), ==, strlen(message));
+    assert_string_equal(buffer, message);
+
+    assert_int(copyFileWithMode(src, src, COPY_MODE_ALWAYS_COPY), ==, COPY_STRATEGY_NONE);
+    assert_true(deleteDirectory(rootDir));
+    return MUNIT_OK;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static void fillDeltaBlock(char *block, uint32_t length, uint32_t seed) {
+    for (uint32_t i = 0; i < length; i++) {
+        block[i] = (char) ((i + seed) * 31 + seed);
+    }
+}
+
+static MunitResult testCopyFileDelta(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/delta_dir");
+    deleteDirectory(rootDir);
+    File *src = FILE_OF(rootDir, "/src.bin");
+    File *dest = FILE_OF(rootDir, "/dest.bin");
+    assert_true(createFileDirs(src));
+    assert_true(createFile(src));
+
+    uint32_t blockSize = 4096;
+    uint32_t blockCount = 64;
+    char *block = malloc(blockSize);
+    for (uint32_t i = 0; i < blockCount; i++) {
+        fillDeltaBlock(block, blockSize, i);
+        assert_uint32(writeCharsToFile(src, block, blockSize, true), ==, blockSize);
+    }
+
+    DeltaCopyStats stats;
+    assert_true(copyFileDelta(src, dest, blockSize, &stats));  // no destination, all data is copied
+    assert_uint64(stats.bytesTransferred, ==, blockSize * blockCount);
+    assert_uint64(stats.bytesSkipped, ==, 0);
+
+    assert_true(copyFileDelta(src, dest, blockSize, &stats));
+    assert_uint64(stats.bytesTransferred, ==, 0);
+    assert_uint64(stats.bytesSkipped, ==, blockSize * blockCount);
+    assert_uint32(stats.blocksSkipped, ==, blockCount);
+
+    int fd = open(src->path, O_WRONLY);
+    assert_int(fd, !=, -1);
+    assert_int(pwrite(fd, "changed", 7, 3 * blockSize + 100), ==, 7);
+    assert_int(pwrite(fd, "x", 1, 40 * blockSize), ==, 1);
+    assert_int(close(fd), ==, 0);
+    assert_true(copyFileDelta(src, dest, blockSize, &stats));
+    assert_uint32(stats.blocksTransferred, ==, 2);
+    assert_uint64(stats.bytesTransferred, ==, 2 * blockSize);
+    assert_uint64(stats.bytesSkipped, ==, (blockCount - 2) * blockSize);
+
+    char *srcData = malloc(blockSize * (blockCount + 1));
+    char *destData = malloc(blockSize * (blockCount + 1));
+    assert_true(writeCharsToFile(src, "tail", 4, true) == 4);  // source grows by partial block
+    assert_true(copyFileDelta(src, dest, 0, &stats));
+    assert_uint32(stats.blockSize, ==, DELTA_COPY_BLOCK_SIZE);
+    assert_uint64(getFileSize(dest), ==, blockSize * blockCount + 4);
+    assert_uint32(readFileToBuffer(dest, destData, blockSize * (blockCount + 1)), ==, blockSize * blockCount + 4);
+    assert_uint32(readFileToBuffer(src, srcData, blockSize * (blockCount + 1)), ==, blockSize * blockCount + 4);
+    assert_memory_equal(blockSize * blockCount + 4, destData, srcData);
+
+    fd = open(src->path, O_WRONLY);
+    assert_int(ftruncate(fd, 10 * blockSize + 5), ==, 0);   // source shrinks
+    assert_int(close(fd), ==, 0);
+    assert_true(copyFileDelta(src, dest, blockSize, &stats));
+    assert_uint64(stats.bytesTransferred, ==, 5);
+    assert_uint64(stats.bytesSkipped, ==, 10 * blockSize);
+    assert_uint64(getFileSize(dest), ==, 10 * blockSize + 5);
+
+    assert_false(copyFileDelta(FILE_OF(rootDir, "/missing.bin"), dest, blockSize, &stats));
+    assert_false(copyFileDelta(src, src, blockSize, &stats));
+
+    free(srcData);
+    free(destData);
+    free(block);
+    assert_true(deleteDirectory(rootDir));
+    return MUNIT_OK;
+}
+#endif
+
+static void createCopyTree(File *rootDir, uint32_t fileCount) {
+    char name[64];
+    char content[256];
+    for (uint32_t i = 0; i < fileCount; i++) {
+        sprintf(name, "/dir_%u/sub_%u/file_%u.txt", i % 3, i % 5, i);
+        File *file = FILE_OF(rootDir, name);
+        assert_true(createFileDirs(file));
+        assert_true(createFile(file));
+        uint32_t length = sprintf(content, "content of file %u", i);
+        assert_uint32(writeCharsToFile(file, content, length, false), ==, length);
+    }
+}
+
+static void assertCopyTreeEquals(File *srcDir, File *destDir, uint32_t fileCount) {
+    fileVector *vec = NEW_VECTOR_BUFF(File, file, calloc(fileCount + 32, sizeof(File)), fileCount + 32);
+    listFiles(destDir, vec, true);
+    assert_uint32(fileVecSize(vec), ==, fileCount);
+
+    char srcContent[256];
+    char destContent[256];
+    for (uint32_t i = 0; i < fileVecSize(vec); i++) {
+        File *destFile = &vec->items[i];
+        File *srcFile = FILE_OF(srcDir, destFile->path + destDir->pathLength);
+        uint32_t length = readFileToBuffer(srcFile, srcContent, sizeof(srcContent));
+        assert_uint32(length, >, 0);
+        assert_uint32(readFileToBuffer(destFile, destContent, sizeof(destContent)), ==, length);
+        assert_string_equal(destContent, srcContent);
+    }
+    free(vec->items);
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static MunitResult testCopySparseFile(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/sparse_dir");
+    deleteDirectory(rootDir);
+    File *src = FILE_OF(rootDir, "/image.bin");
+    File *dest = FILE_OF(rootDir, "/image_copy.bin");
+    assert_true(createFileDirs(src));
+
+    uint64_t size = 64 * ONE_MB;
+    const char *firstData = "first data extent";
+    const char *secondData = "second data extent";
+    int fd = open(src->path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    assert_int(fd, !=, -1);
+    assert_int(ftruncate(fd, (off_t) size), ==, 0);
+    assert_int(pwrite(fd, firstData, strlen(firstData), ONE_MB), ==, strlen(firstData));
+    assert_int(pwrite(fd, secondData, strlen(secondData), 40 * ONE_MB), ==, strlen(secondData));
+    assert_int(close(fd), ==, 0);
+
+    struct stat srcInfo;
+    assert_int(stat(src->path, &srcInfo), ==, 0);
+    bool isSparse = (uint64_t) srcInfo.st_blocks * 512 < size;     // filesystem supports holes
+
+    CopyStrategy strategy = copyFileWithMode(src, dest, COPY_MODE_ALWAYS_COPY);
+    assert_int(strategy, !=, COPY_STRATEGY_NONE);
+    if (isSparse) {
+        assert_int(strategy, ==, COPY_STRATEGY_SPARSE);
+    }
+    assert_uint64(getFileSize(dest), ==, size);
+
+    char buffer[64] = {0};
+    fd = open(dest->path, O_RDONLY);
+    assert_int(pread(fd, buffer, strlen(firstData), ONE_MB), ==, strlen(firstData));
+    assert_string_equal(buffer, firstData);
+    assert_int(pread(fd, buffer, strlen(secondData), 40 * ONE_MB), ==, strlen(secondData));
+    assert_string_equal(buffer, secondData);
+    assert_int(pread(fd, buffer, 8, 20 * ONE_MB), ==, 8);  // hole reads as zeros
+    assert_memory_equal(8, buffer, "\0\0\0\0\0\0\0\0");
+    assert_int(close(fd), ==, 0);
+
+    struct stat destInfo;
+    assert_int(stat(dest->path, &destInfo), ==, 0);
+    if (isSparse) {
+        assert_int64(destInfo.st_blocks, <=, srcInfo.st_blocks + 16);  // allocation matches source, not apparent size
+    }
+
+    assert_true(deleteDirectory(rootDir));
+    return MUNIT_OK;
+}
+#endif
+
+static MunitResult testCopyDirectoryContents(const MunitParameter params[], void *data) {
+    File *srcDir = NEW_FILE(FROM_PATH "/copy_tree_src");
+    File *destDir = NEW_FILE(FROM_PATH "/copy_tree_dest");
+    deleteDirectory(srcDir);
+    deleteDirectory(destDir);
+    uint32_t fileCount = 300;   // more than copy queue, so the walk waits for workers
+    createCopyTree(srcDir, fileCount);
+#if !defined(_WIN32) && !defined(_WIN64)
+    assert_true(mkfifo(FILE_OF(srcDir, "/pipe")->path, 0666) == 0);    // opening it would block
+#endif
+
+    assert_true(MKDIR(destDir->path) == 0);
+    assert_true(copyDirectory(srcDir, destDir));
+    assertCopyTreeEquals(srcDir, destDir, fileCount);
+    assert_false(isFileExists(FILE_OF(destDir, "/pipe")));
+
+#ifdef FILE_UTILS_ENABLE_THREADS
+    assert_true(deleteDirectory(destDir));
+    assert_true(MKDIR(destDir->path) == 0);
+    assert_true(copyDirectoryParallel(srcDir, destDir, 4));
+    assertCopyTreeEquals(srcDir, destDir, fileCount);
+
+    assert_true(copyDirectoryParallel(srcDir, destDir, 2));    // overwrites existing files
+    assertCopyTreeEquals(srcDir, destDir, fileCount);
+    assert_false(copyDirectoryParallel(srcDir, FILE_OF(destDir, "/missing"), 4));
+#endif
+
+    assert_true(deleteDirectory(srcDir));
+    assert_true(deleteDirectory(destDir));
+    return MUNIT_OK;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#define FILE_OP_TEST_FILES 40
+
+static void assertFileOpQueueReads(File *rootDir, FileOpEngine engine) {
+    FileOpQueue queue;
+    assert_true(openFileOpQueue(&queue, 16, engine));   // less than operations, so queue is refilled from completions
+    assert_int(queue.engine, !=, FILE_OP_ENGINE_AUTO);
+
+    File files[FILE_OP_TEST_FILES];
+    FileOp ops[FILE_OP_TEST_FILES];
+    FileOp statOps[FILE_OP_TEST_FILES];
+    struct stat info[FILE_OP_TEST_FILES];
+    char contents[FILE_OP_TEST_FILES][64];
+    uint32_t readCount = 0;
+    uint32_t statCount = 0;
+    uint32_t nextFile = 0;
+
+    // each file goes open -> read -> close by one op, its statx runs in parallel
+    while (readCount < FILE_OP_TEST_FILES || statCount < FILE_OP_TEST_FILES) {
+        while (nextFile < FILE_OP_TEST_FILES && queue.depth - queue.inFlight >= 2) {
+            char name[32];
+            sprintf(name, "/op_file_%u.txt", nextFile);
+            newFileFromParent(&files[nextFile], rootDir, name);
+            ops[nextFile] = (FileOp) {.type = FILE_OP_OPEN, .path = files[nextFile].path, .flags = O_RDONLY | O_CLOEXEC, .userData = &files[nextFile]};
+            statOps[nextFile] = (FileOp) {.type = FILE_OP_STATX, .path = files[nextFile].path, .buffer = &info[nextFile]};
+            assert_true(submitFileOp(&queue, &ops[nextFile]));
+            assert_true(submitFileOp(&queue, &statOps[nextFile]));
+            nextFile++;
+        }
+        assert_true(flushFileOps(&queue));
+
+        FileOp *op = waitFileOp(&queue);
+        assert_not_null(op);
+        assert_int64(op->result, >=, 0);
+        uint32_t index = op->type == FILE_OP_STATX ? op - statOps : op - ops;
+        switch (op->type) {
+            case FILE_OP_OPEN:
+                *op = (FileOp) {.type = FILE_OP_READ, .fd = (int) op->result, .buffer = contents[index], .length = sizeof(contents[index]) - 1};
+                assert_true(submitFileOp(&queue, op));
+                break;
+            case FILE_OP_READ:
+                contents[index][op->result] = '\0';
+                *op = (FileOp) {.type = FILE_OP_CLOSE, .fd = op->fd};
+                assert_true(submitFileOp(&queue, op));
+                break;
+            case FILE_OP_CLOSE:
+                readCount++;
+                break;
+            case FILE_OP_STATX:
+                assert_true(S_ISREG(info[index].st_mode));
+                assert_int64(info[index].st_size, ==, getFileSize(&files[index]));
+                statCount++;
+                break;
+            default:
+                assert_true(false);
+        }
+    }
+    assert_uint32(queue.inFlight, ==, 0);
+    assert_null(waitFileOp(&queue));
+    assert_null(pollFileOp(&queue));
+
+    for (uint32_t i = 0; i < FILE_OP_TEST_FILES; i++) {
+        char expected[64];
+        sprintf(expected, "queued content %u", i);
+        assert_string_equal(contents[i], expected);
+    }
+
+    FileOp missing = {.type = FILE_OP_OPEN, .path = FILE_OF(rootDir, "/missing.txt")->path, .flags = O_RDONLY};
+    assert_true(submitFileOp(&queue, &missing));
+    assert_ptr_equal(waitFileOp(&queue), &missing);
+    assert_int64(missing.result, ==, -ENOENT);
+
+    char data[] = "written by queue";
+    FileOp write = {.type = FILE_OP_OPEN, .path = FILE_OF(rootDir, "/op_written.txt")->path, .flags = O_WRONLY | O_CREAT | O_TRUNC};
+    assert_true(submitFileOp(&queue, &write));
+    assert_ptr_equal(waitFileOp(&queue), &write);
+    assert_int64(write.result, >=, 0);
+    write = (FileOp) {.type = FILE_OP_WRITE, .fd = (int) write.result, .buffer = data, .length = sizeof(data) - 1, .offset = 4};
+    assert_true(submitFileOp(&queue, &write));
+    assert_ptr_equal(waitFileOp(&queue), &write);
+    assert_int64(write.result, ==, sizeof(data) - 1);
+    write = (FileOp) {.type = FILE_OP_CLOSE, .fd = write.fd};
+    assert_true(submitFileOp(&queue, &write));
+    assert_ptr_equal(waitFileOp(&queue), &write);
+    assert_int64(write.result, ==, 0);
+    assert_uint64(getFileSize(FILE_OF(rootDir, "/op_written.txt")), ==, sizeof(data) - 1 + 4);
+
+    closeFileOpQueue(&queue);
+    assert_null(queue.backend);
+}
+
+static MunitResult testFileOpQueue(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/file_op_dir");
+    deleteDirectory(rootDir);
+    assert_true(createSubDirs(rootDir));
+    assert_true(MKDIR(rootDir->path) == 0);
+    for (uint32_t i = 0; i < FILE_OP_TEST_FILES; i++) {
+        char name[32];
+        char content[64];
+        sprintf(name, "/op_file_%u.txt", i);
+        File *file = FILE_OF(rootDir, name);
+        assert_true(createFile(file));
+        uint32_t length = sprintf(content, "queued content %u", i);
+        assert_uint32(writeCharsToFile(file, content, length, false), ==, length);
+    }
+
+    assertFileOpQueueReads(rootDir, FILE_OP_ENGINE_AUTO);
+    assertFileOpQueueReads(rootDir, FILE_OP_ENGINE_SYNC);
+#ifdef FILE_UTILS_ENABLE_THREADS
+    assertFileOpQueueReads(rootDir, FILE_OP_ENGINE_THREADS);
+#endif
+    FileOpQueue queue;
+    if (openFileOpQueue(&queue, 16, FILE_OP_ENGINE_IO_URING)) {     // kernel may not support it
+        closeFileOpQueue(&queue);
+        assertFileOpQueueReads(rootDir, FILE_OP_ENGINE_IO_URING);
+    }
+
+    FileOp op = {.type = FILE_OP_CLOSE, .fd = -1};
+    assert_true(openFileOpQueue(&queue, 1, FILE_OP_ENGINE_SYNC));
+    assert_true(submitFileOp(&queue, &op));
+    assert_false(submitFileOp(&queue, &op));    // queue is full until operation is returned
+    assert_ptr_equal(pollFileOp(&queue), &op);
+    assert_int64(op.result, ==, -EBADF);
+    closeFileOpQueue(&queue);
+
+    assert_true(deleteDirectory(rootDir));
+    return MUNIT_OK;
+}
+#endif
+
+typedef struct ProgressRecord {
+    uint32_t callCount;
+    uint32_t cancelAfterCalls;     // 0 - never cancel
+    CopyProgress last;
+} ProgressRecord;
+
+static bool recordCopyProgress(CopyProgress *progress, void *context) {
+    ProgressRecord *record = context;
+    assert_uint64(progress->bytesDone, >=, record->last.bytesDone);
+    assert_uint32(progress->filesDone, >=, record->last.filesDone);
+    assert_double(progress->elapsedSeconds, >=, 0);
+    record->last = *progress;
+    record->callCount++;
+    return record->cancelAfterCalls == 0 || record->callCount < record->cancelAfterCalls;
+}
+
+static MunitResult testCopyWithProgress(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/progress_dir");
+    deleteDirectory(rootDir);
+    File *src = FILE_OF(rootDir, "/src.bin");
+    File *dest = FILE_OF(rootDir, "/copy/dest.bin");
+    assert_true(createFileDirs(src));
+    assert_true(createFile(src));
+
+    uint32_t blockSize = 64 * 1024;
+    char *block = calloc(1, blockSize);
+    for (uint32_t i = 0; i < 48; i++) {     // 3 MB
+        assert_uint32(writeCharsToFile(src, block, blockSize, true), ==, blockSize);
+    }
+    uint64_t size = 48 * blockSize;
+
+    ProgressRecord record = {0};
+    CopyProgressOptions options = {.callback = recordCopyProgress, .context = &record, .callbackBytes = 256 * 1024};
+    CopyStats stats;
+    assert_true(copyFileWithProgress(src, dest, &options, &stats));
+    assert_uint32(record.callCount, >=, 1);     // clone reports whole file at once
+    assert_uint64(record.last.bytesDone, ==, size);
+    assert_uint64(record.last.bytesTotal, ==, size);
+    assert_uint32(record.last.filesDone, ==, 1);
+    assert_uint64(stats.bytes, ==, size);
+    assert_uint32(stats.files, ==, 1);
+    assert_uint64(stats.syscalls, >, 0);
+    assert_false(stats.isCancelled);
+    assert_uint64(getFileSize(dest), ==, size);
+
+    record = (ProgressRecord) {.cancelAfterCalls = 1};
+    options.callbackBytes = 0;
+    options.callbackFiles = 1;
+    assert_true(copyFileWithProgress(src, dest, &options, &stats));    // cancelled after last file is done
+    assert_false(stats.isCancelled);
+
+    File *srcDir = FILE_OF(rootDir, "/tree");
+    File *destDir = FILE_OF(rootDir, "/tree_copy");
+    uint32_t fileCount = 30;
+    createCopyTree(srcDir, fileCount);
+    assert_true(MKDIR(destDir->path) == 0);
+
+    record = (ProgressRecord) {0};
+    options = (CopyProgressOptions) {.callback = recordCopyProgress, .context = &record, .callbackFiles = 10};
+    assert_true(copyDirectoryWithProgress(srcDir, destDir, &options, &stats));
+    assert_uint32(record.callCount, ==, 3);
+    assert_uint32(record.last.filesTotal, ==, fileCount);
+    assert_uint32(record.last.filesDone, ==, fileCount);
+    assert_uint64(record.last.bytesDone, ==, record.last.bytesTotal);
+    assert_uint32(stats.files, ==, fileCount);
+    assertCopyTreeEquals(srcDir, destDir, fileCount);
+
+    assert_true(deleteDirectory(destDir));
+    assert_true(MKDIR(destDir->path) == 0);
+    record = (ProgressRecord) {.cancelAfterCalls = 1};
+    assert_false(copyDirectoryWithProgress(srcDir, destDir, &options, &stats));
+    assert_true(stats.isCancelled);
+    assert_uint32(stats.files, ==, 10);
+    fileVector *vec = NEW_VECTOR_64(file);
+    listFiles(destDir, vec, true);
+    assert_uint32(fileVecSize(vec), ==, 10);
+
+    record = (ProgressRecord) {.cancelAfterCalls = 1};     // cancel in the middle of the file
+    options = (CopyProgressOptions) {.callback = recordCopyProgress, .context = &record, .callbackBytes = 256 * 1024};
+    File *cancelled = FILE_OF(rootDir, "/cancelled.bin");
+    bool isCopied = copyFileWithProgress(src, cancelled, &options, &stats);
+    if (!isCopied) {    // clone can't be cancelled in the middle
+        assert_true(stats.isCancelled);
+        assert_uint64(stats.bytes, <, size);
+        assert_false(isFileExists(cancelled));
+    }
+
+    record = (ProgressRecord) {0};
+    options = (CopyProgressOptions) {.callback = recordCopyProgress, .context = &record, .callbackFiles = 1};
+    File *movedDir = FILE_OF(rootDir, "/moved");
+    assert_true(moveDirToDirWithProgress(srcDir, movedDir, &options, &stats));
+    assert_uint32(stats.files, ==, fileCount);
+    assert_uint32(record.callCount, ==, 1);     // renamed at once
+    assert_uint64(record.last.bytesDone, ==, record.last.bytesTotal);
+    assert_false(isDirExists(srcDir));
+    assert_true(moveFileToDirWithProgress(src, movedDir, NULL, &stats));
+    assert_uint64(stats.bytes, ==, size);
+    assert_false(isFileExists(src));
+
+    free(block);
+    assert_true(deleteDirectory(rootDir));
+    return MUNIT_OK;
+}
+
+static MunitResult testCopyAndCleanLargeDir(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/large_dir");
+    File *copyDir = NEW_FILE(FROM_PATH "/large_dir_copy");
+    deleteDirectory(rootDir);
+    deleteDirectory(copyDir);
+
+    File *subDir = FILE_OF(rootDir, "/dir_1/dir_2/dir_3");
+    assert_true(createSubDirs(subDir));
+    assert_true(MKDIR(subDir->path) == 0);
+    assert_true(MKDIR(copyDir->path) == 0);
+
+    uint32_t fileCount = 400;   // more than fits into any fixed size buffer
+    for (uint32_t i = 0; i < fileCount; i++) {
+        char name[32];
+        sprintf(name, "file_%u.txt", i);
+        assert_true(createFile(FILE_OF(i % 2 == 0 ? rootDir : subDir, name)));
+    }
+
+    assert_true(copyDirectory(rootDir, copyDir));
+    File *vecBuffer = calloc(fileCount + 8, sizeof(File));
+    fileVector *vec = NEW_VECTOR_BUFF(File, file, vecBuffer, fileCount + 8);
+    listFilesAndDirs(copyDir, vec, true);
+    assert_uint32(fileVecSize(vec), ==, fileCount + 3);
+    assert_true(fileVecContains(vec, *FILE_OF(copyDir, "/dir_1/dir_2/dir_3/file_399.txt")));
+    fileVecClear(vec);
+
+    cleanDirectory(rootDir);
+    assert_true(isEmptyDir(rootDir));
+    listFilesAndDirs(rootDir, vec, true);
+    assert_uint32(fileVecSize(vec), ==, 0);
+
+    assert_true(deleteDirectory(copyDir));
+    assert_true(deleteDirectory(rootDir));
+    free(vecBuffer);
+    return MUNIT_OK;
+}
+
+static MunitResult testWalkTooDeepDir(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/deep_dir");
+    File *copyDir = NEW_FILE(FROM_PATH "/deep_dir_copy");
+    deleteDirectory(rootDir);
+    deleteDirectory(copyDir);
+    assert_true(createSubDirs(rootDir));
+    assert_true(MKDIR(rootDir->path) == 0);
+    assert_true(MKDIR(copyDir->path) == 0);
+
+    uint32_t dirDepth = MAX_DIR_DEPTH + 6;
+    File deepDir = *rootDir;
+    for (uint32_t i = 0; i < dirDepth; i++) {
+        deepDir = *FILE_OF(&deepDir, "/d");
+        assert_true(MKDIR(deepDir.path) == 0);
+    }
+    assert_true(createFile(FILE_OF(&deepDir, "/file.txt")));
+
+    FileIterator iterator;      // walk goes on, but reports that deepest levels are skipped
+    assert_true(openFileIterator(&iterator, rootDir, true));
+    uint32_t count = 0;
+    while (nextFileOrDir(&iterator) != NULL) {
+        count++;
+    }
+    assert_true(iterator.isFailed);
+    assert_uint32(count, ==, MAX_DIR_DEPTH);     // directories up to the last level that can be opened
+    closeFileIterator(&iterator);
+
+    FileList *list = NEW_FILE_LIST(128, 128 * 4 * MAX_DIR_DEPTH);
+    assert_false(listFilesAndDirsToList(rootDir, list, true));
+    assert_false(copyDirectory(rootDir, copyDir));
+#ifdef FILE_UTILS_ENABLE_THREADS
+    assert_false(copyDirectoryParallel(rootDir, copyDir, 4));
+#endif
+
+    for (uint32_t i = 0; i < 2; i++) {  // deleteDirectory() can't reach deepest levels either, remove them from the bottom
+        File dir = i == 0 ? *rootDir : *copyDir;
+        for (uint32_t j = 0; j < dirDepth; j++) {
+            dir = *FILE_OF(&dir, "/d");
+        }
+        remove(FILE_OF(&dir, "/file.txt")->path);
+        for (uint32_t j = 0; j < dirDepth; j++) {
+            rmdir(dir.path);
+            dir = *PARENT_FILE(&dir);
+        }
+        assert_true(deleteDirectory(i == 0 ? rootDir : copyDir));
+    }
+    return MUNIT_OK;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#define LONG_PATH_NAME_LENGTH 200
+#define LONG_PATH_LEVELS (PATH_MAX_LEN / LONG_PATH_NAME_LENGTH + 2)
+
+// Path of such tree doesn't fit into File, so it's created and removed relative to parent descriptors
+static void removeLongPathTree(File *rootDir, const char *name) {
+    int dirs[LONG_PATH_LEVELS + 1];
+    uint32_t depth = 0;
+    dirs[0] = open(rootDir->path, O_RDONLY | O_DIRECTORY);
+    while (dirs[depth] != -1 && depth < LONG_PATH_LEVELS) {
+        dirs[depth + 1] = openat(dirs[depth], name, O_RDONLY | O_DIRECTORY);
+        depth++;
+    }
+    for (uint32_t i = depth; i > 0; i--) {
+        if (dirs[i] != -1) {
+            unlinkat(dirs[i], "file.txt", 0);
+            close(dirs[i]);
+        }
+        unlinkat(dirs[i - 1], name, AT_REMOVEDIR);
+    }
+    if (dirs[0] != -1) close(dirs[0]);
+}
+
+static MunitResult testWalkTooLongPath(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/long_path_dir");
+    File *copyDir = NEW_FILE(FROM_PATH "/long_path_dir_copy");
+    char name[LONG_PATH_NAME_LENGTH + 1];
+    memset(name, 'n', LONG_PATH_NAME_LENGTH);
+    name[LONG_PATH_NAME_LENGTH] = '\0';
+    removeLongPathTree(rootDir, name);
+    removeLongPathTree(copyDir, name);
+    deleteDirectory(rootDir);
+    deleteDirectory(copyDir);
+    assert_true(createSubDirs(rootDir));
+    assert_true(MKDIR(rootDir->path) == 0);
+    assert_true(MKDIR(copyDir->path) == 0);
+
+    int dirFd = open(rootDir->path, O_RDONLY | O_DIRECTORY);
+    for (uint32_t i = 0; i < LONG_PATH_LEVELS; i++) {
+        assert_int(mkdirat(dirFd, name, S_IRWXU), ==, 0);
+        int childFd = openat(dirFd, name, O_RDONLY | O_DIRECTORY);
+        assert_int(childFd, !=, -1);
+        close(dirFd);
+        dirFd = childFd;
+    }
+    int fileFd = openat(dirFd, "file.txt", O_WRONLY | O_CREAT, 0666);
+    assert_int(fileFd, !=, -1);
+    close(fileFd);
+    close(dirFd);
+
+    FileIterator iterator;
+    assert_true(openFileIterator(&iterator, rootDir, true));
+    while (nextFileOrDir(&iterator) != NULL);
+    assert_true(iterator.isFailed);
+    closeFileIterator(&iterator);
+    assert_false(copyDirectory(rootDir, copyDir));
+    assert_false(deleteDirectory(rootDir));
+
+    removeLongPathTree(rootDir, name);
+    removeLongPathTree(copyDir, name);
+    assert_true(deleteDirectory(rootDir));
+    assert_true(deleteDirectory(copyDir));
+    return MUNIT_OK;
+}
+#endif
+
 static MunitResult testMoveFileAndDir(const MunitParameter params[], void *data) {
     // Src dir
     File *rootDir = NEW_FILE(FROM_PATH "/dir_t");
@@ -284,6 +1460,96 @@ static MunitResult testMoveFileAndDir(const MunitParameter params[], void *data)
     return MUNIT_OK;
 }
 
+#if !defined(_WIN32) && !defined(_WIN64)
+static ino_t getFileInode(File *file) {
+    struct stat info;
+    return stat(file->path, &info) == 0 ? info.st_ino : 0;
+}
+
+static MunitResult testMoveWithRename(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/rename_dir");
+    deleteDirectory(rootDir);
+    File *destDir = FILE_OF(rootDir, "/dest");
+    File *src = FILE_OF(rootDir, "/file.txt");
+    File *moved = FILE_OF(destDir, "/file.txt");
+    assert_true(createFileDirs(src));
+    assert_true(createFile(src));
+    assert_uint32(writeCharsToFile(src, "first", 5, false), ==, 5);
+
+    ino_t inode = getFileInode(src);
+    assert_true(moveFileToDir(src, destDir));   // same filesystem, file is renamed, not copied
+    assert_false(isFileExists(src));
+    assert_uint64(getFileInode(moved), ==, inode);
+
+    assert_true(createFile(src));
+    assert_uint32(writeCharsToFile(src, "second", 6, false), ==, 6);
+    assert_false(moveFileToDirWithMode(src, destDir, MOVE_MODE_NO_REPLACE));
+    assert_true(isFileExists(src));
+    assert_uint64(getFileSize(moved), ==, 5);
+    assert_true(moveFileToDirWithMode(src, destDir, MOVE_MODE_REPLACE));
+    assert_false(isFileExists(src));
+    assert_uint64(getFileSize(moved), ==, 6);
+
+    // Existing destination directory is merged with source
+    File *srcDir = FILE_OF(rootDir, "/tree");
+    File *srcSubDir = FILE_OF(srcDir, "/sub");
+    assert_true(createSubDirs(srcSubDir));
+    assert_true(MKDIR(srcSubDir->path) == 0);
+    assert_true(createFile(FILE_OF(srcSubDir, "/one.txt")));
+    assert_true(createFile(FILE_OF(srcDir, "/two.txt")));
+    File *destSubDir = FILE_OF(destDir, "/sub");
+    assert_true(MKDIR(destSubDir->path) == 0);
+    assert_true(createFile(FILE_OF(destSubDir, "/three.txt")));
+    inode = getFileInode(FILE_OF(srcSubDir, "/one.txt"));
+
+    assert_true(moveDirToDirWithMode(srcDir, destDir, MOVE_MODE_NO_REPLACE));
+    assert_false(isDirExists(srcDir));
+    assert_uint64(getFileInode(FILE_OF(destSubDir, "/one.txt")), ==, inode);
+    assert_true(isFileExists(FILE_OF(destSubDir, "/three.txt")));
+    assert_true(isFileExists(FILE_OF(destDir, "/two.txt")));
+
+    assert_true(createSubDirs(srcSubDir));
+    assert_true(MKDIR(srcSubDir->path) == 0);
+    assert_true(createFile(FILE_OF(srcSubDir, "/three.txt")));
+    assert_false(moveDirToDirWithMode(srcDir, destDir, MOVE_MODE_NO_REPLACE));
+    assert_true(isFileExists(FILE_OF(srcSubDir, "/three.txt")));     // not moved entries stay in source
+    assert_true(moveDirToDir(srcDir, destDir));
+    assert_false(isDirExists(srcDir));
+    assert_false(moveDirToDir(destDir, destSubDir));    // can't move into itself
+
+    // Whole directory is renamed when destination doesn't exist
+    File *renamedDir = FILE_OF(rootDir, "/renamed/dest");
+    inode = getFileInode(destDir);
+    assert_true(moveDirToDir(destDir, renamedDir));
+    assert_false(isDirExists(destDir));
+    assert_uint64(getFileInode(renamedDir), ==, inode);
+    assert_true(isFileExists(FILE_OF(renamedDir, "/sub/one.txt")));
+
+    // Other filesystem can't be renamed to, data is copied
+    File *otherFsDir = NEW_FILE("/dev/shm/file_utils_move");
+    struct stat rootInfo, otherInfo;
+    deleteDirectory(otherFsDir);
+    if (stat(rootDir->path, &rootInfo) == 0 && stat("/dev/shm", &otherInfo) == 0 && rootInfo.st_dev != otherInfo.st_dev) {
+        assert_true(moveDirToDir(renamedDir, otherFsDir));
+        assert_false(isDirExists(renamedDir));
+        assert_true(isFileExists(FILE_OF(otherFsDir, "/sub/one.txt")));
+        assert_true(isFileExists(FILE_OF(otherFsDir, "/two.txt")));
+
+        File *otherFsFile = FILE_OF(otherFsDir, "/file.txt");
+        assert_true(createFile(src));
+        assert_false(moveFileToDirWithMode(src, otherFsDir, MOVE_MODE_NO_REPLACE));
+        assert_uint64(getFileSize(otherFsFile), ==, 6);
+        assert_true(moveFileToDir(src, otherFsDir));
+        assert_false(isFileExists(src));
+        assert_uint64(getFileSize(otherFsFile), ==, 0);
+        assert_true(deleteDirectory(otherFsDir));
+    }
+
+    assert_true(deleteDirectory(rootDir));
+    return MUNIT_OK;
+}
+#endif
+
 static MunitResult testReadFileToBuffer(const MunitParameter params[], void *data) {
     File *file = NEW_FILE("test_file_buff.txt");
     assert_true(createFile(file));
@@ -321,6 +1587,422 @@ static MunitResult testReadFileToString(const MunitParameter params[], void *dat
     return MUNIT_OK;
 }
 
+static MunitResult testWriteStringsToFile(const MunitParameter params[], void *data) {
+    File *file = NEW_FILE(FROM_PATH "/strings_file.txt");
+    remove(file->path);
+    assert_true(createFileDirs(file));
+
+    BufferString *header = NEW_STRING_64("header;");
+    BufferString *empty = EMPTY_STRING(16);
+    BufferString *footer = NEW_STRING_64("footer");
+    BufferString *parts[] = {header, empty, footer};
+    assert_uint64(writeStringsToFile(file, parts, 3, false), ==, 0);   // not existing file
+
+    assert_true(createFile(file));
+    assert_uint64(writeStringsToFile(file, parts, 3, false), ==, header->length + footer->length);
+    assert_uint64(writeStringsToFile(file, parts, 0, true), ==, 0);
+
+    BufferString *result = EMPTY_STRING(64);
+    assert_true(readFileToString(file, result) > 0);
+    assert_string_equal(result->value, "header;footer");
+
+    // more parts than single writev() can take
+    uint32_t count = 3000;
+    BufferString *strings = calloc(count, sizeof(BufferString));
+    BufferString **records = malloc(count * sizeof(BufferString *));
+    char *values = malloc(count * 8);
+    assert_true(strings != NULL && records != NULL && values != NULL);
+    uint64_t expectedLength = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        strings[i].value = values + (i * 8);
+        strings[i].length = sprintf(strings[i].value, "%u;", i);
+        strings[i].capacity = 8;
+        records[i] = &strings[i];
+        expectedLength += strings[i].length;
+    }
+    assert_uint64(writeStringsToFile(file, records, count, true), ==, expectedLength);
+    assert_uint64(getFileSize(file), ==, header->length + footer->length + expectedLength);
+
+    uint64_t fileSize = getFileSize(file);
+    char *contents = calloc(fileSize + 1, sizeof(char));
+    assert_not_null(contents);
+    assert_uint64(readFileToBuffer(file, contents, fileSize + 1), ==, fileSize);
+    assert_true(strncmp(contents, "header;footer0;1;2;", 19) == 0);
+    assert_true(strstr(contents, "1023;1024;1025;") != NULL);
+    assert_true(strstr(contents, "2998;2999;") != NULL);
+    free(contents);
+    free(values);
+    free(records);
+    free(strings);
+
+    assert_uint64(writeStringsToFile(file, parts, 3, false), ==, header->length + footer->length);    // truncate
+    assert_uint64(getFileSize(file), ==, header->length + footer->length);
+    remove(file->path);
+    return MUNIT_OK;
+}
+
+static MunitResult testWriteFileAtomic(const MunitParameter params[], void *data) {
+    File *dir = NEW_FILE(FROM_PATH "/atomic_write");
+    deleteDirectory(dir);
+    assert_true(createSubDirs(dir));
+    assert_true(MKDIR(dir->path) == 0);
+    File *config = FILE_OF(dir, "/config.txt");
+
+    BufferString *str = NEW_STRING_64("old contents, longer than new");
+    assert_true(writeStringToFileAtomic(config, str, WRITE_DURABILITY_NONE));    // created when missing
+    assert_uint64(getFileSize(config), ==, str->length);
+#if !defined(_WIN32) && !defined(_WIN64)
+    assert_true(chmod(config->path, S_IRUSR | S_IWUSR) == 0);
+#endif
+
+    WriteDurability levels[] = {WRITE_DURABILITY_NONE, WRITE_DURABILITY_DATA, WRITE_DURABILITY_FULL};
+    char *contents[] = {"none", "data synced", "data and dir synced"};
+    for (uint32_t i = 0; i < 3; i++) {
+        assert_true(writeCharsToFileAtomic(config, contents[i], strlen(contents[i]), levels[i]));
+        BufferString *result = EMPTY_STRING(64);
+        assert_true(readFileToString(config, result) > 0);
+        assert_string_equal(result->value, contents[i]);
+    }
+    assert_true(writeCharsToFileAtomic(config, NULL, 0, WRITE_DURABILITY_NONE));
+    assert_uint64(getFileSize(config), ==, 0);
+    assert_false(writeCharsToFileAtomic(config, NULL, 1, WRITE_DURABILITY_NONE));
+    assert_false(writeCharsToFileAtomic(FILE_OF(dir, "/missing/config.txt"), "x", 1, WRITE_DURABILITY_NONE));
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct stat info;
+    assert_true(stat(config->path, &info) == 0);
+    assert_int((int) (info.st_mode & 0777), ==, S_IRUSR | S_IWUSR);    // permissions of replaced file are kept
+#endif
+    fileVector *vec = NEW_VECTOR_64(file);
+    listFilesAndDirs(dir, vec, false);
+    assert_uint32(fileVecSize(vec), ==, 1);    // no temp files left
+
+    assert_true(deleteDirectory(dir));
+    return MUNIT_OK;
+}
+
+static MunitResult testFileHandle(const MunitParameter params[], void *data) {
+    File *file = NEW_FILE(FROM_PATH "/handle_file.txt");
+    remove(file->path);
+    assert_true(createFileDirs(file));
+    assert_false(openFileHandle(file, FILE_HANDLE_READ));   // missing file
+    assert_null(file->file);
+    assert_uint64(writeFileHandle(file, "x", 1), ==, 0);
+    assert_false(closeFileHandle(file));
+
+    char *record = "record;";
+    uint32_t recordLength = strlen(record);
+    uint32_t recordCount = 1000;
+    assert_false(openFileHandle(file, (FileHandleMode) 42));
+    assert_null(file->file);
+    assert_true(openFileHandle(file, FILE_HANDLE_APPEND));
+    FILE *openedStream = file->file;
+    assert_false(openFileHandle(file, FILE_HANDLE_READ));     // opened handle isn't replaced
+    assert_ptr_equal(file->file, openedStream);
+    for (uint32_t i = 0; i < recordCount; i++) {
+        assert_uint64(writeFileHandle(file, record, recordLength), ==, recordLength);
+        if (i == recordCount / 2) {
+            assert_true(isFileExists(file));    // doesn't replace opened handle
+            assert_true(flushFileHandle(file));
+            assert_uint64(getFileSize(file), ==, (i + 1) * recordLength);
+        }
+    }
+    assert_true(closeFileHandle(file));
+    assert_null(file->file);
+    assert_false(flushFileHandle(file));
+    assert_uint64(getFileSize(file), ==, recordCount * recordLength);
+
+    char buffer[64] = {0};
+    assert_true(openFileHandle(file, FILE_HANDLE_READ));
+    for (uint32_t i = 0; i < 3; i++) {  // reads continue from previous position
+        assert_uint64(readFileHandle(file, buffer, recordLength), ==, recordLength);
+        assert_memory_equal(recordLength, buffer, record);
+    }
+    assert_true(closeFileHandle(file));
+
+    assert_true(openFileHandle(file, FILE_HANDLE_WRITE));   // truncates
+    assert_uint64(writeFileHandle(file, "new", 3), ==, 3);
+    assert_true(closeFileHandle(file));
+    assert_uint64(getFileSize(file), ==, 3);
+
+    assert_true(openFileHandle(file, FILE_HANDLE_READ_WRITE));
+    assert_uint64(writeFileHandle(file, "N", 1), ==, 1);
+    assert_true(flushFileHandle(file));
+    assert_uint64(readFileHandle(file, buffer, sizeof(buffer)), ==, 2);
+    assert_memory_equal(2, buffer, "ew");
+    assert_true(closeFileHandle(file));
+    assert_uint64(readFileToBuffer(file, buffer, sizeof(buffer) - 1), ==, 3);
+    assert_string_equal(buffer, "New");
+
+    remove(file->path);
+    assert_uint64(writeCharsToFile(file, "x", 1, true), ==, 0);     // plain write doesn't create file
+    return MUNIT_OK;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64) && defined(FILE_UTILS_ENABLE_THREADS)
+#define APPEND_TEST_THREADS 4
+#define APPEND_TEST_RECORDS 2000
+#define APPEND_TEST_RECORD_LENGTH 16
+
+typedef struct AppendTestThread {
+    AppendWriter *writer;
+    uint32_t id;
+    bool isAppended;
+} AppendTestThread;
+
+typedef struct BatchRecord {
+    pthread_mutex_t lock;
+    uint32_t batchCount;
+    uint64_t records;
+} BatchRecord;
+
+static void recordAppendBatch(AppendBatch *batch, void *context) {
+    BatchRecord *record = context;
+    assert_uint32(batch->records, >, 0);
+    assert_uint64(batch->bytes, ==, batch->records * APPEND_TEST_RECORD_LENGTH);
+    assert_double(batch->latencySeconds, >=, batch->writeSeconds);
+    pthread_mutex_lock(&record->lock);
+    record->batchCount++;
+    record->records += batch->records;
+    pthread_mutex_unlock(&record->lock);
+}
+
+static void *appendTestRecords(void *arg) {
+    AppendTestThread *thread = arg;
+    thread->isAppended = true;
+    for (uint32_t i = 0; i < APPEND_TEST_RECORDS; i++) {
+        char record[APPEND_TEST_RECORD_LENGTH + 1];
+        snprintf(record, sizeof(record), "t%u:%010u\n", thread->id, i);     // 16 bytes
+        uint64_t position;
+        thread->isAppended &= appendRecord(thread->writer, record, APPEND_TEST_RECORD_LENGTH, &position);
+        if (i % 500 == 0) {
+            thread->isAppended &= waitAppendDurable(thread->writer, position);
+        }
+    }
+    return NULL;
+}
+
+static MunitResult testAppendWriter(const MunitParameter params[], void *data) {
+    File *file = NEW_FILE(FROM_PATH "/append_journal.log");
+    remove(file->path);
+    assert_true(createFileDirs(file));
+
+    BatchRecord batches = {.lock = PTHREAD_MUTEX_INITIALIZER};
+    AppendWriterOptions options = {.bufferSize = 4096, .flushBytes = 1024, .batchCallback = recordAppendBatch, .context = &batches};
+    AppendWriter writer;
+    assert_true(openAppendWriter(&writer, file, &options));
+    assert_uint32(writer.options.flushDelayUs, ==, APPEND_WRITER_FLUSH_DELAY_US);
+    char tooLarge[4097] = {0};
+    assert_false(appendRecord(&writer, tooLarge, sizeof(tooLarge), NULL));
+
+    AppendTestThread threads[APPEND_TEST_THREADS];
+    pthread_t threadIds[APPEND_TEST_THREADS];
+    for (uint32_t i = 0; i < APPEND_TEST_THREADS; i++) {    // small buffer wraps around and fills up many times
+        threads[i] = (AppendTestThread) {.writer = &writer, .id = i};
+        assert_int(pthread_create(&threadIds[i], NULL, appendTestRecords, &threads[i]), ==, 0);
+    }
+    for (uint32_t i = 0; i < APPEND_TEST_THREADS; i++) {
+        pthread_join(threadIds[i], NULL);
+        assert_true(threads[i].isAppended);
+    }
+
+    AppendWriterStats stats;
+    assert_true(closeAppendWriter(&writer, &stats));
+    uint32_t recordCount = APPEND_TEST_THREADS * APPEND_TEST_RECORDS;
+    assert_uint64(stats.records, ==, recordCount);
+    assert_uint64(stats.bytes, ==, recordCount * APPEND_TEST_RECORD_LENGTH);
+    assert_uint32(stats.batches, ==, batches.batchCount);
+    assert_uint32(stats.batches, <, recordCount);     // records are grouped
+    assert_uint64(batches.records, ==, recordCount);
+    assert_double(stats.maxBatchLatency, >=, stats.avgBatchLatency);
+    assert_uint64(getFileSize(file), ==, recordCount * APPEND_TEST_RECORD_LENGTH);
+
+    // Records of each thread are whole and in order
+    uint32_t nextRecord[APPEND_TEST_THREADS] = {0};
+    char *content = malloc(recordCount * APPEND_TEST_RECORD_LENGTH + 1);
+    assert_uint64(readFileToBuffer(file, content, recordCount * APPEND_TEST_RECORD_LENGTH), ==, recordCount * APPEND_TEST_RECORD_LENGTH);
+    for (uint32_t i = 0; i < recordCount; i++) {
+        unsigned int threadId, index;
+        assert_int(sscanf(content + i * APPEND_TEST_RECORD_LENGTH, "t%u:%u", &threadId, &index), ==, 2);
+        assert_uint32(threadId, <, APPEND_TEST_THREADS);
+        assert_uint32(index, ==, nextRecord[threadId]++);
+    }
+    free(content);
+
+    // Single record waits for flush delay, explicit flush doesn't
+    options = (AppendWriterOptions) {.flushDelayUs = 200000};
+    assert_true(openAppendWriter(&writer, file, &options));
+    uint64_t position;
+    assert_true(appendRecord(&writer, "tail\n", 5, &position));
+    assert_true(flushAppendWriter(&writer));
+    assert_true(waitAppendDurable(&writer, position));
+    getAppendWriterStats(&writer, &stats);
+    assert_uint64(stats.records, ==, 1);
+    assert_double(stats.maxBatchLatency, <, 0.2);
+    assert_true(appendRecord(&writer, "last\n", 5, &position));
+    assert_true(closeAppendWriter(&writer, &stats));   // written on close
+    assert_uint64(stats.records, ==, 2);
+    assert_uint64(getFileSize(file), ==, recordCount * APPEND_TEST_RECORD_LENGTH + 10);
+    assert_false(appendRecord(&writer, "x", 1, NULL));
+
+    remove(file->path);
+    return MUNIT_OK;
+}
+#endif
+
+static MunitResult testFileView(const MunitParameter params[], void *data) {
+    File *file = NEW_FILE(FROM_PATH "/view_file.txt");
+    remove(file->path);
+    FileView view;
+    assert_false(openFileView(file, &view, FILE_VIEW_HINT_NONE, false));
+    assert_null(view.data);
+
+    assert_true(createFileDirs(file));
+    assert_true(createFile(file));
+    assert_true(openFileView(file, &view, FILE_VIEW_HINT_NONE, false));    // empty file
+    assert_uint64(view.length, ==, 0);
+    assert_false(view.isMapped);
+    closeFileView(&view);
+
+    char *content = "key_1=value_1;key_2=value_2;";
+    uint32_t length = strlen(content);
+    assert_uint32(writeCharsToFile(file, content, length, false), ==, length);
+    FileViewHint hints[] = {FILE_VIEW_HINT_NONE, FILE_VIEW_HINT_SEQUENTIAL, FILE_VIEW_HINT_RANDOM, FILE_VIEW_HINT_WILL_NEED};
+    for (uint32_t i = 0; i < ARRAY_SIZE(hints); i++) {
+        assert_true(openFileView(file, &view, hints[i], i % 2 == 0));
+        assert_uint64(view.length, ==, length);
+        assert_memory_equal(length, view.data, content);
+
+        BufferString str;
+        assert_not_null(getFileViewString(&view, 14, 5, &str));
+        assert_memory_equal(5, str.value, "key_2");
+        assert_uint32(str.length, ==, 5);
+        assert_not_null(getFileViewString(&view, 20, 64, &str));     // cut at the end of file
+        assert_uint32(str.length, ==, length - 20);
+        assert_not_null(getFileViewString(&view, length, 1, &str));
+        assert_uint32(str.length, ==, 0);
+        assert_null(getFileViewString(&view, length + 1, 1, &str));
+        closeFileView(&view);
+        assert_null(view.data);
+    }
+
+    assert_true(openFileView(file, &view, FILE_VIEW_HINT_NONE, false));
+    assert_uint32(writeCharsToFile(file, "KEY", 3, true), ==, 3);
+    assert_uint64(view.length, ==, length);     // view keeps length it was opened with
+    closeFileView(&view);
+
+    remove(file->path);
+    return MUNIT_OK;
+}
+
+typedef struct ChunkRecord {
+    const char *content;
+    uint64_t bytes;
+    uint32_t chunkCount;
+    uint32_t stopAfterChunks;      // 0 - read till end of file
+} ChunkRecord;
+
+static bool recordFileChunk(const char *chunk, uint32_t length, uint64_t offset, void *context) {
+    ChunkRecord *record = context;
+    assert_uint64(offset, ==, record->bytes);
+    assert_memory_equal(length, chunk, record->content + offset);
+    record->bytes += length;
+    record->chunkCount++;
+    return record->stopAfterChunks == 0 || record->chunkCount < record->stopAfterChunks;
+}
+
+static MunitResult testReadFileByChunks(const MunitParameter params[], void *data) {
+    File *file = NEW_FILE(FROM_PATH "/chunked_file.bin");
+    remove(file->path);
+    char buffer[4096];
+    ChunkRecord record = {0};
+    assert_false(readFileByChunks(file, buffer, sizeof(buffer), recordFileChunk, &record));
+
+    assert_true(createFileDirs(file));
+    assert_true(createFile(file));
+    assert_true(readFileByChunks(file, buffer, sizeof(buffer), recordFileChunk, &record));    // empty file
+    assert_uint32(record.chunkCount, ==, 0);
+
+    uint32_t length = 10 * sizeof(buffer) + 100;    // 11 chunks, much more than the buffer
+    char *content = malloc(length);
+    for (uint32_t i = 0; i < length; i++) {
+        content[i] = (char) (i % 251);
+    }
+    assert_uint32(writeCharsToFile(file, content, length, false), ==, length);
+
+    record = (ChunkRecord) {.content = content};
+    assert_true(readFileByChunks(file, buffer, sizeof(buffer), recordFileChunk, &record));
+    assert_uint64(record.bytes, ==, length);
+    assert_uint32(record.chunkCount, ==, 11);
+
+    record = (ChunkRecord) {.content = content, .stopAfterChunks = 3};
+    assert_false(readFileByChunks(file, buffer, sizeof(buffer), recordFileChunk, &record));
+    assert_uint64(record.bytes, ==, 3 * sizeof(buffer));
+
+    FileReader reader;
+    assert_true(openFileReader(file, &reader, buffer, sizeof(buffer)));
+    uint64_t total = 0;
+    uint32_t chunkLength;
+    while ((chunkLength = readNextChunk(&reader)) > 0) {
+        assert_uint64(reader.offset, ==, total);
+        assert_memory_equal(chunkLength, reader.buffer, content + total);
+        total += chunkLength;
+    }
+    assert_uint64(total, ==, length);
+    assert_false(reader.isFailed);
+    assert_uint32(readNextChunk(&reader), ==, 0);
+    closeFileReader(&reader);
+
+    free(content);
+    remove(file->path);
+    return MUNIT_OK;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static MunitResult testLargeFileSize(const MunitParameter params[], void *data) {
+    File *rootDir = NEW_FILE(FROM_PATH "/large_file_dir");
+    deleteDirectory(rootDir);
+    File *file = FILE_OF(rootDir, "/sparse.bin");
+    File *copy = FILE_OF(rootDir, "/sparse_copy.bin");
+    assert_true(createFileDirs(file));
+    assert_true(createFile(file));
+
+    uint64_t size = 5ULL * 1024 * 1024 * 1024;     // over 32-bit range, holes take no disk space
+    uint64_t markOffset = size - 4096;
+    int fd = open(file->path, O_WRONLY);
+    assert_int(fd, !=, -1);
+    bool isSparse = ftruncate(fd, (off_t) size) == 0 && pwrite(fd, "mark", 4, (off_t) markOffset) == 4;
+    close(fd);
+    if (!isSparse) {
+        deleteDirectory(rootDir);
+        return MUNIT_SKIP;  // filesystem without large or sparse files
+    }
+
+    assert_uint64(getFileSize(file), ==, size);
+    assert_uint64(writeCharsToFile(file, "tail", 4, true), ==, 4);
+    assert_uint64(getFileSize(file), ==, size + 4);
+
+    char buffer[16];
+    assert_uint64(readFileToBuffer(file, buffer, sizeof(buffer) - 1), ==, sizeof(buffer) - 1);  // 64-bit size is cut to buffer
+
+    if (sizeof(size_t) == 8) {
+        FileView view;
+        assert_true(openFileView(file, &view, FILE_VIEW_HINT_RANDOM, false));
+        assert_uint64(view.length, ==, size + 4);
+        assert_memory_equal(4, view.data + markOffset, "mark");
+        assert_memory_equal(4, view.data + size, "tail");
+        closeFileView(&view);
+    }
+
+    assert_true(copyFile(file, copy));
+    assert_uint64(getFileSize(copy), ==, size + 4);
+    assert_uint64(getFileSize(rootDir), ==, 0);     // directory has no file size
+
+    assert_true(deleteDirectory(rootDir));
+    return MUNIT_OK;
+}
+#endif
+
 static MunitResult testBytesToStr(const MunitParameter params[], void *data) {
     BufferString *str = EMPTY_STRING(64);
 
@@ -427,10 +2109,55 @@ static MunitTest fileUtilsTests[] = {
         {.name =  "Test getFileSize() - should correctly return file length", .test = testFileSize},
         {.name =  "Test parent and file name - should correctly get file name", .test = testFileNameAndParent},
         {.name =  "Test list of files - should correctly get all files from dir", .test = testFileList},
+        {.name =  "Test file iterator - should walk files one by one", .test = testFileIterator},
+        {.name =  "Test file list - should pack listing into single buffer", .test = testCompactFileList},
+        {.name =  "Test sorted listing - should order paths same as strcmp()", .test = testSortedListing},
+        {.name =  "Test cached listing - should read again only changed directories", .test = testCachedListing},
+#if defined(__linux__)
+        {.name =  "Test directory index - should follow changes by inotify events", .test = testDirIndex},
+        {.name =  "Test directory index overflow - should rescan changed directories", .test = testDirIndexOverflow},
+#endif
+        {.name =  "Test filtered file listing - should skip entries rejected by filter", .test = testListFilesFiltered},
+        {.name =  "Test buffered file listing - should list same entries as readdir()", .test = testListFilesBuffered},
+#ifdef FILE_UTILS_ENABLE_THREADS
+        {.name =  "Test parallel file listing - should visit all entries with multiple threads", .test = testListFilesParallel},
+#endif
         {.name =  "Test copy file/dir - should correctly copy file and directory", .test = testCopyFileAndDir},
+        {.name =  "Test copy file contents - should copy all data in one pass", .test = testCopyFileContents},
+        {.name =  "Test copy file with mode - should clone or copy file data", .test = testCopyFileWithMode},
+#if !defined(_WIN32) && !defined(_WIN64)
+        {.name =  "Test delta copy - should write only changed blocks", .test = testCopyFileDelta},
+#endif
+#if !defined(_WIN32) && !defined(_WIN64)
+        {.name =  "Test copy sparse file - should keep holes in copy", .test = testCopySparseFile},
+#endif
+        {.name =  "Test copy directory contents - should copy data of all files", .test = testCopyDirectoryContents},
+#if !defined(_WIN32) && !defined(_WIN64)
+        {.name =  "Test file operation queue - should complete queued operations with each engine", .test = testFileOpQueue},
+#endif
+        {.name =  "Test copy with progress - should report progress and stop when cancelled", .test = testCopyWithProgress},
+        {.name =  "Test copy and clean large dir - should walk whole directory tree", .test = testCopyAndCleanLargeDir},
+        {.name =  "Test walk too deep dir - should report failure instead of skipping deepest levels", .test = testWalkTooDeepDir},
+#if !defined(_WIN32) && !defined(_WIN64)
+        {.name =  "Test walk too long path - should report failure instead of skipping entry", .test = testWalkTooLongPath},
+#endif
         {.name =  "Test move file/dir - should correctly move file and directory", .test = testMoveFileAndDir},
+#if !defined(_WIN32) && !defined(_WIN64)
+        {.name =  "Test move with rename - should rename on same filesystem and copy across filesystems", .test = testMoveWithRename},
+#endif
         {.name =  "Test file to buffer - should correctly read file to byte array", .test = testReadFileToBuffer},
         {.name =  "Test file to string - should correctly read file to buffer string", .test = testReadFileToString},
+        {.name =  "Test write strings to file - should write all parts with single open", .test = testWriteStringsToFile},
+        {.name =  "Test atomic write - should replace file contents with temp file rename", .test = testWriteFileAtomic},
+        {.name =  "Test file handle - should keep file open between writes and reads", .test = testFileHandle},
+#if !defined(_WIN32) && !defined(_WIN64) && defined(FILE_UTILS_ENABLE_THREADS)
+        {.name =  "Test append writer - should write records of many threads in batches", .test = testAppendWriter},
+#endif
+        {.name =  "Test file view - should read file contents without copying", .test = testFileView},
+        {.name =  "Test read file by chunks - should pass whole file through one buffer", .test = testReadFileByChunks},
+#if !defined(_WIN32) && !defined(_WIN64)
+        {.name =  "Test large file size - should keep 64-bit sizes of files over 4 GB", .test = testLargeFileSize},
+#endif
         {.name =  "Test bytes to string - should correctly convert bytes to KB/MB/GB/TB", .test = testBytesToStr},
         {.name =  "Test string to bytes - should correctly convert string with KB/MB/GB/TB to byte count", .test = displaySizeToBytesTest},
         {.name =  "Test file CRC32 - should correctly generate check code from file", .test = testFileCrc32},
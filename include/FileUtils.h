@@ -35,17 +35,347 @@
     #define PATH_MAX_LEN PATH_MAX
 #endif
 
-#ifndef MAX_FILES_IN_DIR
-    #define MAX_FILES_IN_DIR 256
+#ifndef MAX_DIR_DEPTH
+    #define MAX_DIR_DEPTH 64    // max directory nesting for recursive walk, each level holds one opened directory
+#endif
+
+#ifndef MIN_DIR_READ_BUFFER_SIZE
+    #define MIN_DIR_READ_BUFFER_SIZE 4096  // smallest space for one getdents64() call of batched directory read
+#endif
+
+#ifndef FILE_COPY_BUFFER_SIZE
+    #define FILE_COPY_BUFFER_SIZE (128 * 1024)  // stack buffer for read()/write() copy when kernel can't copy files by itself
+#endif
+
+#ifndef DELTA_COPY_BLOCK_SIZE
+    #define DELTA_COPY_BLOCK_SIZE (64 * 1024)   // default compared block for incremental copy, each one costs 8 bytes of signature
+#endif
+
+#ifdef FILE_UTILS_ENABLE_THREADS
+    #ifndef MAX_WALK_THREADS
+        #define MAX_WALK_THREADS 64
+    #endif
+
+    #ifndef PARALLEL_WALK_QUEUE_SIZE
+        #define PARALLEL_WALK_QUEUE_SIZE 64    // per thread directory queue, when it's full thread walks subdirectory by itself
+    #endif
+
+    #ifndef MAX_COPY_THREADS
+        #define MAX_COPY_THREADS 64
+    #endif
+
+    #ifndef PARALLEL_COPY_QUEUE_SIZE
+        #define PARALLEL_COPY_QUEUE_SIZE 128   // opened file pairs waiting for copy workers, each one holds two descriptors
+    #endif
+
+    #ifndef FILE_OP_QUEUE_THREADS
+        #define FILE_OP_QUEUE_THREADS 4     // workers running queued file operations when io_uring is not available
+    #endif
+
+    #ifndef APPEND_WRITER_BUFFER_SIZE
+        #define APPEND_WRITER_BUFFER_SIZE (4 * 1024 * 1024)    // records waiting for disk, appending blocks when it's full
+    #endif
+
+    #ifndef APPEND_WRITER_FLUSH_BYTES
+        #define APPEND_WRITER_FLUSH_BYTES (256 * 1024)  // batch is written as soon as it has this many bytes
+    #endif
+
+    #ifndef APPEND_WRITER_FLUSH_DELAY_US
+        #define APPEND_WRITER_FLUSH_DELAY_US 2000   // or when its first record has waited this long
+    #endif
+#endif
+
+#if defined(DT_UNKNOWN) && !defined(IGNORE_DIRENT_TYPE)
+    #define USE_DIRENT_TYPE     // trust 'd_type' from readdir(), stat() entry only when filesystem reports DT_UNKNOWN
 #endif
 
 typedef struct File {
-    FILE *file;
+    FILE *file;     // handle opened by openFileHandle(), NULL when closed
     DIR *dir;
     uint32_t pathLength;
     char path[PATH_MAX_LEN];
 } File;
 
+typedef enum FileType {
+    FILE_TYPE_REGULAR,
+    FILE_TYPE_DIRECTORY,
+    FILE_TYPE_OTHER
+} FileType;
+
+// Directory walk with explicit stack of opened directories. Each child is opened and examined relative to its parent
+// descriptor (openat/fstatat), so kernel resolves single path component per entry regardless of depth
+typedef struct FileIterator {
+    DIR *dirs[MAX_DIR_DEPTH];
+    uint32_t dirPathLengths[MAX_DIR_DEPTH];
+    uint32_t depth;
+    bool recursive;
+    bool followLinks;
+    bool isDescendPending;
+    bool isFailed;          // directory couldn't be opened or read, nested deeper than MAX_DIR_DEPTH or entry path is longer than PATH_MAX_LEN. Walk goes on with other entries
+    File entry;             // path of current entry
+    const char *entryName;  // points to the name part of 'entry.path'
+    FileType entryType;
+#if defined(__linux__)
+    char *readBuffer;       // optional getdents64() buffer shared by all levels, NULL for readdir()
+    uint32_t readBufferSize;
+    uint32_t batchStart[MAX_DIR_DEPTH];     // per level part of 'readBuffer' with not yet visited entries
+    uint32_t batchPosition[MAX_DIR_DEPTH];
+    uint32_t batchEnd[MAX_DIR_DEPTH];
+    int64_t batchOffset[MAX_DIR_DEPTH];     // directory offset after last visited entry, used when batch is dropped
+#endif
+} FileIterator;
+
+// Compact listing: paths are packed one after another into single arena, per entry data is kept in separate arrays.
+// All of it lives in one caller buffer, entry takes path length + 8 bytes instead of full File struct
+typedef struct FileList {
+    uint32_t *pathOffsets;
+    uint16_t *pathLengths;
+    uint8_t *types;         // FileType
+    char *pathArena;        // NUL terminated paths
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t arenaLength;
+    uint32_t arenaCapacity;
+} FileList;
+
+#define FILE_LIST_ENTRY_SIZE (sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint8_t))
+#define FILE_LIST_BUFFER_SIZE(entries, arenaSize) ((entries) * FILE_LIST_ENTRY_SIZE + (arenaSize) + sizeof(uint32_t))
+#define NEW_FILE_LIST(entries, arenaSize) newFileList(&(FileList){0}, (char[FILE_LIST_BUFFER_SIZE(entries, arenaSize)]){0}, FILE_LIST_BUFFER_SIZE(entries, arenaSize), entries)
+#define FILE_LIST_GET(list, index) fileListGet(list, index, &(File){0})
+
+// Listing filter checked during the walk, so rejected entries are never copied and excluded directories are not opened.
+// Zero/NULL fields are not checked, size and modification time cost one fstatat() per entry only when set
+typedef struct FileFilter {
+    const char *namePattern;        // glob for entry name: '*', '?' and '[a-z]', '[!a-z]' sets
+    const char **extensions;        // without dot, case insensitive: {"txt", "log"}
+    uint32_t extensionCount;
+    uint64_t minSize;
+    uint64_t maxSize;
+    time_t modifiedAfter;
+    time_t modifiedBefore;
+    uint32_t maxDepth;              // 1 - only directory itself, 0 - unlimited
+    const char *excludeDirPattern;  // glob for directory names to skip with all contents
+    bool includeDirs;               // directories are checked only by 'excludeDirPattern' and 'maxDepth'
+} FileFilter;
+
+typedef bool (*FileVisitor)(File *file, FileType type, void *context);    // return 'false' to stop the walk
+
+typedef enum CopyMode {
+    COPY_MODE_CLONE_OR_COPY,    // share data blocks when filesystem supports it (btrfs, XFS), copy otherwise
+    COPY_MODE_CLONE_ONLY,       // fail when file can't be cloned
+    COPY_MODE_ALWAYS_COPY       // always write separate copy of data
+} CopyMode;
+
+typedef enum CopyStrategy {
+    COPY_STRATEGY_NONE,         // file has not been copied
+    COPY_STRATEGY_CLONE,        // copy-on-write clone with ioctl(FICLONE), only metadata is written
+    COPY_STRATEGY_COPY_RANGE,   // copy_file_range() in kernel
+    COPY_STRATEGY_SENDFILE,     // sendfile() in kernel
+    COPY_STRATEGY_BLOCKS,       // read()/write() by FILE_COPY_BUFFER_SIZE blocks
+    COPY_STRATEGY_SPARSE        // only data extents of sparse file, holes are kept in copy
+} CopyStrategy;
+
+typedef enum MoveMode {
+    MOVE_MODE_REPLACE,          // existing destination files are overwritten
+    MOVE_MODE_NO_REPLACE        // fail when destination file exists, directories are still merged
+} MoveMode;
+
+typedef struct CopyProgress {
+    uint64_t bytesDone;
+    uint64_t bytesTotal;        // counted before copy starts, zero for directory copy without callback
+    uint32_t filesDone;
+    uint32_t filesTotal;
+    double elapsedSeconds;
+    double bytesPerSecond;      // since previous callback
+} CopyProgress;
+
+typedef bool (*CopyProgressCallback)(CopyProgress *progress, void *context);   // return 'false' to cancel the copy
+
+typedef struct CopyProgressOptions {
+    CopyProgressCallback callback;
+    void *context;
+    uint64_t callbackBytes;     // call after each N copied bytes, 0 - don't call by bytes
+    uint32_t callbackFiles;     // call after each N copied files, 0 - don't call by files
+} CopyProgressOptions;
+
+typedef struct CopyStats {
+    uint64_t bytes;
+    uint32_t files;
+    uint64_t syscalls;          // calls made to open, copy and close files and create directories
+    double seconds;
+    bool isCancelled;
+} CopyStats;
+
+// Result of copyFileDelta(). Local delta copy trades extra reads for fewer writes: destination is read in full, then
+// again for blocks with matching weak checksum, so it is slower than copyFile() when writes are cheap
+typedef struct DeltaCopyStats {
+    uint64_t bytesTransferred;  // written to destination
+    uint64_t bytesSkipped;      // blocks that destination already had at the same offset
+    uint32_t blocksTransferred;
+    uint32_t blocksSkipped;
+    uint32_t blockSize;
+} DeltaCopyStats;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+typedef enum FileOpType {
+    FILE_OP_OPEN,           // open(path, flags, 0666), result is descriptor
+    FILE_OP_READ,           // pread(fd, buffer, length, offset), result is read bytes
+    FILE_OP_WRITE,          // pwrite(fd, buffer, length, offset), result is written bytes
+    FILE_OP_CLOSE,          // close(fd)
+    FILE_OP_STATX           // stat(path) to 'struct stat' in buffer
+} FileOpType;
+
+typedef enum FileOpEngine {
+    FILE_OP_ENGINE_AUTO,        // first available of the engines below
+    FILE_OP_ENGINE_IO_URING,    // Linux 5.6+, operations are submitted to kernel in batches and run there
+    FILE_OP_ENGINE_THREADS,     // FILE_OP_QUEUE_THREADS workers with blocking calls, needs FILE_UTILS_ENABLE_THREADS
+    FILE_OP_ENGINE_SYNC         // operation runs in submitFileOp()
+} FileOpEngine;
+
+// Queued file operation, it's owned by caller and must stay in place until it's returned by waitFileOp()/pollFileOp()
+typedef struct FileOp {
+    FileOpType type;
+    const char *path;
+    int flags;
+    int fd;
+    void *buffer;
+    uint32_t length;
+    uint64_t offset;
+    int64_t result;         // syscall result or negative errno
+    void *userData;
+} FileOp;
+
+// Submission/completion queue of file operations, so single thread can keep many of them in flight.
+// Operations complete in any order, dependent ones (read after open) should be submitted after previous completes.
+// With io_uring submitted operations reach kernel on flushFileOps() or waitFileOp(), pollFileOp() only checks completions
+typedef struct FileOpBackend FileOpBackend;
+
+typedef struct FileOpQueue {
+    FileOpEngine engine;    // engine that was opened, never AUTO
+    uint32_t depth;         // max operations in flight
+    uint32_t inFlight;      // submitted and not yet returned
+    FileOpBackend *backend;
+} FileOpQueue;
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64) && defined(FILE_UTILS_ENABLE_THREADS)
+typedef struct AppendBatch {
+    uint32_t records;
+    uint64_t bytes;
+    double writeSeconds;        // writev() and fdatasync()
+    double latencySeconds;      // from first record of the batch being appended until it's on disk
+} AppendBatch;
+
+typedef void (*AppendBatchCallback)(AppendBatch *batch, void *context);  // called from flusher thread
+
+typedef struct AppendWriterOptions {
+    uint32_t bufferSize;        // 0 - APPEND_WRITER_BUFFER_SIZE, max record length
+    uint32_t flushBytes;        // 0 - APPEND_WRITER_FLUSH_BYTES
+    uint32_t flushDelayUs;      // 0 - APPEND_WRITER_FLUSH_DELAY_US
+    bool isSyncSkipped;         // batches are only written, without fdatasync()
+    AppendBatchCallback batchCallback;
+    void *context;
+} AppendWriterOptions;
+
+typedef struct AppendWriterStats {
+    uint64_t records;           // on disk
+    uint64_t bytes;
+    uint32_t batches;
+    double seconds;             // since writer was opened
+    double recordsPerSecond;
+    double avgBatchLatency;     // seconds, see AppendBatch
+    double maxBatchLatency;
+} AppendWriterStats;
+
+// Group commit journal: records from any number of threads are collected in memory ring and flusher thread writes
+// them with one writev() and one fdatasync() per batch. Record is durable when waitAppendDurable() returns for it.
+// Writer is used by flusher thread, it must stay in place until closed
+typedef struct AppendWriterState AppendWriterState;
+
+typedef struct AppendWriter {
+    AppendWriterOptions options;    // with defaults applied
+    AppendWriterState *state;
+} AppendWriter;
+#endif
+
+typedef enum FileHandleMode {
+    FILE_HANDLE_READ,           // existing file from the start
+    FILE_HANDLE_WRITE,          // file is created or truncated
+    FILE_HANDLE_APPEND,         // file is created when missing, each write goes to the end
+    FILE_HANDLE_READ_WRITE      // existing file from the start, not truncated. Flush or seek when switching read and write
+} FileHandleMode;
+
+typedef enum WriteDurability {
+    WRITE_DURABILITY_NONE,      // readers see old or new contents, after power loss file can be empty
+    WRITE_DURABILITY_DATA,      // fdatasync() of new contents before rename, old or new contents after power loss
+    WRITE_DURABILITY_FULL       // also fsync() of parent dir, rename itself survives power loss
+} WriteDurability;
+
+typedef enum FileViewHint {
+    FILE_VIEW_HINT_NONE,            // default kernel readahead
+    FILE_VIEW_HINT_SEQUENTIAL,      // madvise(MADV_SEQUENTIAL), aggressive readahead for single pass over the file
+    FILE_VIEW_HINT_RANDOM,          // madvise(MADV_RANDOM), no readahead for scattered lookups
+    FILE_VIEW_HINT_WILL_NEED        // madvise(MADV_WILLNEED), start reading whole file in background
+} FileViewHint;
+
+// Read only view of whole file contents. On POSIX file is mapped with mmap() and pages are shared with page cache,
+// so reading through the view copies nothing. On Windows contents are read to heap buffer once
+typedef struct FileView {
+    const char *data;       // not null terminated, writing to it crashes
+    uint64_t length;
+    bool isMapped;          // false for empty file and heap buffer
+} FileView;
+
+// Reads file by successive chunks into one caller buffer, so file of any size is processed with fixed memory.
+// Each chunk fills whole buffer, only the last one can be shorter
+typedef struct FileReader {
+    char *buffer;
+    uint32_t capacity;
+    uint32_t length;        // bytes of current chunk
+    uint64_t offset;        // file position of current chunk
+    bool isFailed;          // read error, reader stops as on end of file
+#if defined(_WIN32) || defined(_WIN64)
+    FILE *stream;
+#else
+    int fd;
+#endif
+} FileReader;
+
+typedef bool (*FileChunkCallback)(const char *chunk, uint32_t length, uint64_t offset, void *context);   // 'false' stops reading
+
+// Snapshot of directory listings keyed by directory path. Directory is read again only when its inode or modification
+// time has changed, unchanged ones cost one stat() instead of opening and reading them
+typedef struct DirCacheRecord DirCacheRecord;
+
+typedef struct DirCache {
+    DirCacheRecord *records;
+    uint32_t *slots;            // hash table of record index + 1, zero for empty slot
+    uint32_t recordCount;
+    uint32_t recordCapacity;
+    uint32_t slotCount;
+    uint32_t hits;              // directories listed from snapshot
+    uint32_t misses;            // directories read from disk
+} DirCache;
+
+#if defined(__linux__)
+// Live set of directory tree entries, kept current by inotify events after initial walk.
+// Lookups and enumeration don't touch the filesystem, changes are applied by updateDirIndex()
+typedef struct DirIndexEntry DirIndexEntry;
+typedef struct DirIndexWatch DirIndexWatch;
+
+typedef struct DirIndex {
+    int notifyFd;               // inotify descriptor, can be polled for pending changes
+    DirIndexEntry *entries;     // hash set of entry paths
+    uint32_t entryCount;
+    uint32_t usedSlots;         // entries and removed slots
+    uint32_t slotCount;
+    DirIndexWatch *watches;     // watched directories by watch descriptor
+    uint32_t watchCapacity;
+    uint32_t overflowCount;     // lost event queues, each one caused rescan of changed directories
+    File root;
+} DirIndex;
+#endif
+
 typedef File file;
 CREATE_CUSTOM_COMPARATOR(filePath, File, one, two, strcmp(one.path, two.path));
 CREATE_VECTOR_TYPE(File, file, filePathComparator);
@@ -78,21 +408,107 @@ BufferString *getParentName(File *file, BufferString *result);
 
 void listFiles(File *directory, fileVector *vec, bool recursive);
 void listFilesAndDirs(File *directory, fileVector *vec, bool recursive);
+void listFilesBuffered(File *directory, fileVector *vec, bool recursive, char *buffer, uint32_t length);
+void listFilesAndDirsBuffered(File *directory, fileVector *vec, bool recursive, char *buffer, uint32_t length);
+
+FileList *newFileList(FileList *list, void *buffer, uint32_t bufferSize, uint32_t maxEntries);
+bool listFilesToList(File *directory, FileList *list, bool recursive);
+bool listFilesAndDirsToList(File *directory, FileList *list, bool recursive);
+bool addToFileList(FileList *list, const char *path, uint32_t length, FileType type);
+void listFilesFiltered(File *directory, fileVector *vec, FileFilter *filter);
+bool listFilesFilteredToList(File *directory, FileList *list, FileFilter *filter);
+void initDirCache(DirCache *cache);
+void listFilesCached(DirCache *cache, File *directory, fileVector *vec, bool recursive);
+void listFilesAndDirsCached(DirCache *cache, File *directory, fileVector *vec, bool recursive);
+void freeDirCache(DirCache *cache);
+#if defined(__linux__)
+bool openDirIndex(DirIndex *index, File *directory);
+uint32_t updateDirIndex(DirIndex *index);
+bool isInDirIndex(DirIndex *index, File *file);
+void dirIndexToVec(DirIndex *index, fileVector *vec, bool includeDirs);
+void closeDirIndex(DirIndex *index);
+#endif
+bool isFileNameMatches(const char *name, const char *pattern);
+const char *fileListPath(FileList *list, uint32_t index);
+File *fileListGet(FileList *list, uint32_t index, File *file);
+void clearFileList(FileList *list);
+
+void sortFileList(FileList *list);
+void sortFileVector(fileVector *vec, uint32_t *order);
+
+bool openFileIterator(FileIterator *iterator, File *directory, bool recursive);
+bool openFileIteratorBuffered(FileIterator *iterator, File *directory, bool recursive, char *buffer, uint32_t length);
+File *nextFile(FileIterator *iterator);
+File *nextFileOrDir(FileIterator *iterator);
+File *nextFilteredFile(FileIterator *iterator, FileFilter *filter);
+void closeFileIterator(FileIterator *iterator);
+
+#ifdef FILE_UTILS_ENABLE_THREADS
+uint32_t listFilesParallel(File *directory, uint32_t threads, FileVisitor visitor, void *context);
+void listFilesParallelToVec(File *directory, fileVector *vec, uint32_t threads, bool sorted);
+#endif
 
 void cleanDirectory(File *directory);
 bool deleteDirectory(File *dir);
 
 bool copyFile(File *srcFile, File *destFile);
+CopyStrategy copyFileWithMode(File *srcFile, File *destFile, CopyMode mode);
+bool copyFileDelta(File *srcFile, File *destFile, uint32_t blockSize, DeltaCopyStats *stats);
+bool copyFileWithProgress(File *srcFile, File *destFile, CopyProgressOptions *options, CopyStats *stats);
 bool copyDirectory(File *srcDir, File *destDir);
+bool copyDirectoryWithProgress(File *srcDir, File *destDir, CopyProgressOptions *options, CopyStats *stats);
+#ifdef FILE_UTILS_ENABLE_THREADS
+bool copyDirectoryParallel(File *srcDir, File *destDir, uint32_t threads);
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64)
+bool openFileOpQueue(FileOpQueue *queue, uint32_t depth, FileOpEngine engine);
+bool submitFileOp(FileOpQueue *queue, FileOp *op);
+bool flushFileOps(FileOpQueue *queue);
+FileOp *waitFileOp(FileOpQueue *queue);
+FileOp *pollFileOp(FileOpQueue *queue);
+void closeFileOpQueue(FileOpQueue *queue);
+#endif
 
 bool moveFileToDir(File *srcFile, File *destDir);
+bool moveFileToDirWithMode(File *srcFile, File *destDir, MoveMode mode);
+bool moveFileToDirWithProgress(File *srcFile, File *destDir, CopyProgressOptions *options, CopyStats *stats);
 bool moveDirToDir(File *srcDir, File *destDir);
+bool moveDirToDirWithMode(File *srcDir, File *destDir, MoveMode mode);
+bool moveDirToDirWithProgress(File *srcDir, File *destDir, CopyProgressOptions *options, CopyStats *stats);
 
-uint32_t readFileToBuffer(File *file, char *buffer, uint32_t length);
+uint64_t readFileToBuffer(File *file, char *buffer, uint64_t length);
 uint32_t readFileToString(File *file, BufferString *str);
 
-uint32_t writeCharsToFile(File *file, const char *data, uint32_t length, bool append);
+bool openFileView(File *file, FileView *view, FileViewHint hint, bool isPopulated);
+BufferString *getFileViewString(FileView *view, uint64_t offset, uint32_t length, BufferString *str);
+void closeFileView(FileView *view);
+
+bool openFileReader(File *file, FileReader *reader, char *buffer, uint32_t capacity);
+uint32_t readNextChunk(FileReader *reader);
+void closeFileReader(FileReader *reader);
+bool readFileByChunks(File *file, char *buffer, uint32_t length, FileChunkCallback callback, void *context);
+
+uint64_t writeCharsToFile(File *file, const char *data, uint64_t length, bool append);
 uint32_t writeStringToFile(File *file, BufferString *str, bool append);
+uint64_t writeStringsToFile(File *file, BufferString **parts, uint32_t count, bool append);
+bool writeCharsToFileAtomic(File *file, const char *data, uint64_t length, WriteDurability durability);
+bool writeStringToFileAtomic(File *file, BufferString *str, WriteDurability durability);
+
+bool openFileHandle(File *file, FileHandleMode mode);
+uint64_t writeFileHandle(File *file, const char *data, uint64_t length);
+uint64_t readFileHandle(File *file, char *buffer, uint64_t length);
+bool flushFileHandle(File *file);
+bool closeFileHandle(File *file);
+
+#if !defined(_WIN32) && !defined(_WIN64) && defined(FILE_UTILS_ENABLE_THREADS)
+bool openAppendWriter(AppendWriter *writer, File *file, AppendWriterOptions *options);
+bool appendRecord(AppendWriter *writer, const char *data, uint32_t length, uint64_t *position);
+bool waitAppendDurable(AppendWriter *writer, uint64_t position);
+bool flushAppendWriter(AppendWriter *writer);
+void getAppendWriterStats(AppendWriter *writer, AppendWriterStats *stats);
+bool closeAppendWriter(AppendWriter *writer, AppendWriterStats *stats);
+#endif
 
 BufferString *byteCountToDisplaySize(uint64_t bytes, BufferString *result);
 uint64_t displaySizeToBytes(const char *sizeStr);